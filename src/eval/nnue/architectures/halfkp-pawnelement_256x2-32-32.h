@@ -1,7 +1,7 @@
 ﻿// Definition of input features and network structure used in NNUE evaluation function
 
-#ifndef HALFKP_PAWN_256X2_32_32_H
-#define HALFKP_PAWN_256X2_32_32_H
+#ifndef HALFKP_PAWNELEMENT_256X2_32_32_H
+#define HALFKP_PAWNELEMENT_256X2_32_32_H
 
 #include "../features/feature_set.h"
 #include "../features/half_kp.h"
@@ -15,26 +15,29 @@ namespace Eval {
 
 namespace NNUE {
 
-// Input features used in evaluation function
-using RawFeatures = Features::FeatureSet<
-    Features::HalfKP<Features::Side::kFriend>, Features::PawnElement<Features::PawnElementType::kNeighbours>>;
+namespace Architectures {
 
-// Number of input feature dimensions after conversion
-constexpr IndexType kTransformedFeatureDimensions = 256;
+struct HalfKP_PawnElement_256x2_32_32 {
+  // Input features used in evaluation function
+  using RawFeatures = Features::FeatureSet<
+      Features::HalfKP<Features::Side::kFriend>, Features::PawnElement<Features::PawnElementType::kNeighbours>>;
 
-namespace Layers {
+  // Number of input feature dimensions after conversion
+  static constexpr IndexType kTransformedFeatureDimensions = 256;
 
-// define network structure
-using InputLayer = InputSlice<kTransformedFeatureDimensions * 2>;
-using HiddenLayer1 = ClippedReLU<AffineTransform<InputLayer, 32>>;
-using HiddenLayer2 = ClippedReLU<AffineTransform<HiddenLayer1, 32>>;
-using OutputLayer = AffineTransform<HiddenLayer2, 1>;
+  // define network structure
+  using InputLayer = Layers::InputSlice<kTransformedFeatureDimensions * 2>;
+  using HiddenLayer1 = Layers::ClippedReLU<Layers::AffineTransform<InputLayer, 32>>;
+  using HiddenLayer2 = Layers::ClippedReLU<Layers::AffineTransform<HiddenLayer1, 32>>;
+  using OutputLayer = Layers::AffineTransform<HiddenLayer2, 1>;
 
-}  // namespace Layers
+  using Network = OutputLayer;
+};
 
-using Network = Layers::OutputLayer;
+}  // namespace Architectures
 
 }  // namespace NNUE
 
 }  // namespace Eval
-#endif // HALFKP_256X2_32_32_H
+
+#endif // HALFKP_PAWNELEMENT_256X2_32_32_H
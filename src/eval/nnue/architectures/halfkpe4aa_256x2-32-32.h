@@ -1,7 +1,7 @@
 ﻿// Definition of input features and network structure used in NNUE evaluation function
 
-#ifndef HALFKPE4_256X2_32_32_H
-#define HALFKPE4_256X2_32_32_H
+#ifndef HALFKPE4AA_256X2_32_32_H
+#define HALFKPE4AA_256X2_32_32_H
 
 #include "../features/feature_set.h"
 #include "../features/half_kpe4.h"
@@ -14,26 +14,29 @@ namespace Eval {
 
 namespace NNUE {
 
-// Input features used in evaluation function
-using RawFeatures = Features::FeatureSet<
-    Features::HalfKPE4<Features::Side::kFriend, Features::EffectType::kAll, Features::EffectType::kAll>>;
+namespace Architectures {
 
-// Number of input feature dimensions after conversion
-constexpr IndexType kTransformedFeatureDimensions = 256;
+struct HalfKPE4AA_256x2_32_32 {
+  // Input features used in evaluation function
+  using RawFeatures = Features::FeatureSet<
+      Features::HalfKPE4<Features::Side::kFriend, Features::EffectType::kAll, Features::EffectType::kAll>>;
 
-namespace Layers {
+  // Number of input feature dimensions after conversion
+  static constexpr IndexType kTransformedFeatureDimensions = 256;
 
-// define network structure
-using InputLayer = InputSlice<kTransformedFeatureDimensions * 2>;
-using HiddenLayer1 = ClippedReLU<AffineTransform<InputLayer, 32>>;
-using HiddenLayer2 = ClippedReLU<AffineTransform<HiddenLayer1, 32>>;
-using OutputLayer = AffineTransform<HiddenLayer2, 1>;
+  // define network structure
+  using InputLayer = Layers::InputSlice<kTransformedFeatureDimensions * 2>;
+  using HiddenLayer1 = Layers::ClippedReLU<Layers::AffineTransform<InputLayer, 32>>;
+  using HiddenLayer2 = Layers::ClippedReLU<Layers::AffineTransform<HiddenLayer1, 32>>;
+  using OutputLayer = Layers::AffineTransform<HiddenLayer2, 1>;
 
-}  // namespace Layers
+  using Network = OutputLayer;
+};
 
-using Network = Layers::OutputLayer;
+}  // namespace Architectures
 
 }  // namespace NNUE
 
 }  // namespace Eval
-#endif // HALFKPE4_256X2_32_32_H
+
+#endif // HALFKPE4AA_256X2_32_32_H
@@ -2,12 +2,18 @@
 
 #if defined(EVAL_NNUE)
 
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 
 #include "../../evaluate.h"
 #include "../../position.h"
 #include "../../misc.h"
+#include "../../thread.h"
 #include "../../uci.h"
 
 #include "evaluate_nnue.h"
@@ -18,35 +24,50 @@ namespace Eval {
 
 namespace NNUE {
 
-// Input feature converter
-AlignedPtr<FeatureTransformer> feature_transformer;
-
-// Evaluation function
-AlignedPtr<Network> network;
-
 // Evaluation function file name
 std::string fileName = "nn.bin";
 
 // Saved evaluation function file name
 std::string savedfileName = "nn.bin";
 
-// Get a string that represents the structure of the evaluation function
-std::string GetArchitectureString() {
-  return "Features=" + FeatureTransformer::GetStructureString() +
-      ",Network=" + Network::GetStructureString();
-}
-
 namespace {
 
 namespace Detail {
 
+// Allocate the evaluation function parameters
+// The weights of the feature transformer are read at random by feature index,
+// so they are placed on large pages like the transposition table.
+template <typename T>
+void Allocate(AlignedPtr<T>& pointer) {
+  static_assert(alignof(T) <= 64, "");
+  void* ptr = aligned_large_pages_alloc(sizeof(T));
+  if (!ptr) {
+    std::cout << "info string can't allocate memory. size = " << sizeof(T) << std::endl;
+    exit(1);
+  }
+  pointer = AlignedPtr<T>(reinterpret_cast<T*>(ptr), AlignedDeleter<T>{true, true});
+}
+
 // Initialize the evaluation function parameters
 template <typename T>
 void Initialize(AlignedPtr<T>& pointer) {
-  pointer.reset(reinterpret_cast<T*>(aligned_malloc(sizeof(T), alignof(T))));
+  Allocate(pointer);
   std::memset(pointer.get(), 0, sizeof(T));
 }
 
+// Allocate a copy of the evaluation function parameters
+template <typename T>
+void Copy(AlignedPtr<T>& pointer, const AlignedPtr<T>& source) {
+  Allocate(pointer);
+  std::memcpy(pointer.get(), source.get(), sizeof(T));
+}
+
+// use the evaluation function parameters in place from a mapped image
+template <typename T>
+void Map(AlignedPtr<T>& pointer, char* address) {
+  pointer = AlignedPtr<T>(reinterpret_cast<T*>(address), AlignedDeleter<T>{false});
+}
+
 // read evaluation function parameters
 template <typename T>
 bool ReadParameters(std::istream& stream, const AlignedPtr<T>& pointer) {
@@ -69,18 +90,8 @@ bool WriteParameters(std::ostream& stream, const AlignedPtr<T>& pointer) {
   return pointer->WriteParameters(stream);
 }
 
-}  // namespace Detail
-
-// Initialize the evaluation function parameters
-void Initialize() {
-  Detail::Initialize(feature_transformer);
-  Detail::Initialize(network);
-}
-
-}  // namespace
-
-// read the header
-bool ReadHeader(std::istream& stream,
+// read the header of the given version
+bool ReadHeader(std::istream& stream, std::uint32_t expected_version,
   std::uint32_t* hash_value, std::string* architecture) {
   std::uint32_t version, size;
   stream.read(reinterpret_cast<char*>(&version), sizeof(version));
@@ -91,7 +102,7 @@ bool ReadHeader(std::istream& stream,
   std::cout << std::showbase << std::hex << "version=" << version << ", *hash_value=" << *hash_value << std::dec << std::endl;
 #endif
 
-  if (!stream || version != kVersion) return false;
+  if (!stream || version != expected_version) return false;
   architecture->resize(size);
   stream.read(&(*architecture)[0], size);
 
@@ -102,10 +113,10 @@ bool ReadHeader(std::istream& stream,
   return !stream.fail();
 }
 
-// write the header
-bool WriteHeader(std::ostream& stream,
+// write the header of the given version
+bool WriteHeader(std::ostream& stream, std::uint32_t version,
   std::uint32_t hash_value, const std::string& architecture) {
-  stream.write(reinterpret_cast<const char*>(&kVersion), sizeof(kVersion));
+  stream.write(reinterpret_cast<const char*>(&version), sizeof(version));
   stream.write(reinterpret_cast<const char*>(&hash_value), sizeof(hash_value));
   const std::uint32_t size = static_cast<std::uint32_t>(architecture.size());
   stream.write(reinterpret_cast<const char*>(&size), sizeof(size));
@@ -113,42 +124,217 @@ bool WriteHeader(std::ostream& stream,
   return !stream.fail();
 }
 
-// read evaluation function parameters
+// size of the header
+std::uint64_t HeaderSize(const std::string& architecture) {
+  return sizeof(std::uint32_t) * 3 + architecture.size();
+}
+
+// write zeros up to the given offset
+bool WritePadding(std::ostream& stream, std::uint64_t* position, std::uint64_t offset) {
+  static const char kZeros[kImageAlignment] = {};
+  assert(*position <= offset && offset - *position <= kImageAlignment);
+  stream.write(kZeros, static_cast<std::streamsize>(offset - *position));
+  *position = offset;
+  return !stream.fail();
+}
+
+}  // namespace Detail
+
+// Location of a parameter block in the image
+struct ImageBlock {
+  std::uint64_t offset;
+  std::uint64_t size;
+};
+
+// Layout of the image, written right after the header
+// The parameter blocks are the in-memory representation of the objects,
+// each starting at a multiple of kImageAlignment.
+struct ImageLayout {
+  std::uint32_t layout_version;
+  std::uint32_t weight_layout;
+  ImageBlock feature_transformer;
+  ImageBlock network;
+};
+
+// mapping of the image in use, if any
+void* mapped_image = nullptr;
+std::size_t mapped_image_size = 0;
+
+// Layout of the image of the architecture
+template <typename Architecture>
+ImageLayout MakeImageLayout(std::uint64_t header_size) {
+  ImageLayout layout = {};
+  layout.layout_version = kImageLayoutVersion;
+  layout.weight_layout = kAffineWeightLayout;
+  layout.feature_transformer.offset = CeilToMultiple<std::uint64_t>(
+      header_size + sizeof(ImageLayout), kImageAlignment);
+  layout.feature_transformer.size = sizeof(BasicFeatureTransformer<Architecture>);
+  layout.network.offset = CeilToMultiple<std::uint64_t>(
+      layout.feature_transformer.offset + layout.feature_transformer.size,
+      kImageAlignment);
+  layout.network.size = sizeof(typename Architecture::Network);
+  return layout;
+}
+
+// Initialize the evaluation function parameters
+template <typename Architecture>
+void Initialize() {
+  Detail::Initialize(Parameters<Architecture>::feature_transformer);
+  Detail::Initialize(Parameters<Architecture>::network);
+}
+
+// Copy the parameters to each of the NUMA nodes, or drop the copies if num_nodes is 0
+// Each copy is written by a thread bound to its node, so that its pages are
+// allocated there.
+template <typename Architecture>
+void ReplicateParameters(int num_nodes) {
+  auto& replicas = Parameters<Architecture>::replicas;
+  replicas.clear();
+  replicas.resize(num_nodes);
+  for (int node = 0; node < num_nodes; ++node) {
+    Numa::run_on_node(node, [&] {
+      Detail::Copy(replicas[node].feature_transformer,
+                   Parameters<Architecture>::feature_transformer);
+      Detail::Copy(replicas[node].network, Parameters<Architecture>::network);
+    });
+  }
+}
+
+// Parameters read by the thread of the position: the copy on its NUMA node if any
+template <typename Architecture>
+const BasicFeatureTransformer<Architecture>& LocalFeatureTransformer(const Position& pos) {
+  const auto& replicas = Parameters<Architecture>::replicas;
+  const Thread* th = pos.this_thread();
+  return th && std::size_t(th->numaNode) < replicas.size() ?
+      *replicas[th->numaNode].feature_transformer :
+      *Parameters<Architecture>::feature_transformer;
+}
+
+template <typename Architecture>
+const typename Architecture::Network& LocalNetwork(const Position& pos) {
+  const auto& replicas = Parameters<Architecture>::replicas;
+  const Thread* th = pos.this_thread();
+  return th && std::size_t(th->numaNode) < replicas.size() ?
+      *replicas[th->numaNode].network : *Parameters<Architecture>::network;
+}
+
+// Release the evaluation function parameters
+template <typename Architecture>
+void Release() {
+  Parameters<Architecture>::replicas.clear();
+  BasicFeatureTransformer<Architecture>::ReleaseCompressedWeights();
+  Parameters<Architecture>::feature_transformer.reset();
+  Parameters<Architecture>::network.reset();
+}
+
+// read evaluation function parameters (after the header)
+template <typename Architecture>
 bool ReadParameters(std::istream& stream) {
-  std::uint32_t hash_value;
-  std::string architecture;
-  if (!ReadHeader(stream, &hash_value, &architecture)) return false;
-  if (hash_value != kHashValue) return false;
-  if (!Detail::ReadParameters(stream, feature_transformer)) return false;
-  if (!Detail::ReadParameters(stream, network)) return false;
+  // The copies would keep the previous values
+  Parameters<Architecture>::replicas.clear();
+  if (!Detail::ReadParameters(stream, Parameters<Architecture>::feature_transformer)) return false;
+  if (!Detail::ReadParameters(stream, Parameters<Architecture>::network)) return false;
   return stream && stream.peek() == std::ios::traits_type::eof();
 }
 
 // write evaluation function parameters
+template <typename Architecture>
 bool WriteParameters(std::ostream& stream) {
-  if (!WriteHeader(stream, kHashValue, GetArchitectureString())) return false;
-  if (!Detail::WriteParameters(stream, feature_transformer)) return false;
-  if (!Detail::WriteParameters(stream, network)) return false;
+  if (!WriteHeader(stream, GetHashValue<Architecture>(),
+                   GetArchitectureString<Architecture>())) return false;
+  if (!Detail::WriteParameters(stream, Parameters<Architecture>::feature_transformer)) return false;
+  if (!Detail::WriteParameters(stream, Parameters<Architecture>::network)) return false;
+  return !stream.fail();
+}
+
+// read the parameters from an image (after the header and layout)
+// If mapping is not null, it holds the whole image and is used in place.
+template <typename Architecture>
+bool ReadImage(std::istream& stream, std::uint64_t header_size,
+               const ImageLayout& layout, char* mapping, std::size_t mapping_size) {
+  const auto expected = MakeImageLayout<Architecture>(header_size);
+  if (std::memcmp(&layout, &expected, sizeof(ImageLayout)) != 0) return false;
+
+  auto& feature_transformer = Parameters<Architecture>::feature_transformer;
+  auto& network = Parameters<Architecture>::network;
+  if (mapping) {
+    if (mapping_size < layout.network.offset + layout.network.size) return false;
+    Detail::Map(feature_transformer, mapping + layout.feature_transformer.offset);
+    Detail::Map(network, mapping + layout.network.offset);
+    return true;
+  }
+
+  Initialize<Architecture>();
+  stream.seekg(layout.feature_transformer.offset);
+  stream.read(reinterpret_cast<char*>(feature_transformer.get()),
+              layout.feature_transformer.size);
+  stream.seekg(layout.network.offset);
+  stream.read(reinterpret_cast<char*>(network.get()), layout.network.size);
+  return !stream.fail();
+}
+
+// write the parameters as an image
+template <typename Architecture>
+bool WriteImage(std::ostream& stream) {
+  const std::string architecture = GetArchitectureString<Architecture>();
+  const auto layout = MakeImageLayout<Architecture>(Detail::HeaderSize(architecture));
+  if (!Detail::WriteHeader(stream, kImageVersion, GetHashValue<Architecture>(),
+                           architecture)) return false;
+  stream.write(reinterpret_cast<const char*>(&layout), sizeof(layout));
+
+  std::uint64_t position = Detail::HeaderSize(architecture) + sizeof(layout);
+  if (!Detail::WritePadding(stream, &position, layout.feature_transformer.offset)) return false;
+  stream.write(reinterpret_cast<const char*>(
+      Parameters<Architecture>::feature_transformer.get()),
+      layout.feature_transformer.size);
+  position += layout.feature_transformer.size;
+  if (!Detail::WritePadding(stream, &position, layout.network.offset)) return false;
+  stream.write(reinterpret_cast<const char*>(
+      Parameters<Architecture>::network.get()), layout.network.size);
   return !stream.fail();
 }
 
+// Keep an int8 copy of the weights of the feature transformer that fit
+template <typename Architecture>
+IndexType CompressFeatureWeights() {
+  return Parameters<Architecture>::feature_transformer->CompressWeights();
+}
+
+// Drop the int8 copy of the weights of the feature transformer
+template <typename Architecture>
+void ReleaseCompressedFeatureWeights() {
+  BasicFeatureTransformer<Architecture>::ReleaseCompressedWeights();
+}
+
 // proceed if you can calculate the difference
-static void UpdateAccumulatorIfPossible(const Position& pos) {
-  feature_transformer->UpdateAccumulatorIfPossible(pos);
+// Architectures that can update from any computed ancestor skip this and
+// materialize the accumulator lazily when the position is evaluated.
+template <typename Architecture>
+void UpdateAccumulatorIfPossible(const Position& pos) {
+  if constexpr (!Architecture::RawFeatures::kDirtyPieceDifferential) {
+    LocalFeatureTransformer<Architecture>(pos).UpdateAccumulatorIfPossible(pos);
+  }
 }
 
 // Calculate the evaluation value
-static Value ComputeScore(const Position& pos, bool refresh = false) {
+template <typename Architecture>
+Value ComputeScore(const Position& pos, bool refresh) {
+  using FeatureTransformerType = BasicFeatureTransformer<Architecture>;
+  using NetworkType = typename Architecture::Network;
+
   auto& accumulator = pos.state()->accumulator;
   if (!refresh && accumulator.computed_score) {
     return accumulator.score;
   }
+  pos.this_thread()->nnueEvaluations.fetch_add(1, std::memory_order_relaxed);
 
   alignas(kCacheLineSize) TransformedFeatureType
-      transformed_features[FeatureTransformer::kBufferSize];
-  feature_transformer->Transform(pos, transformed_features, refresh);
-  alignas(kCacheLineSize) char buffer[Network::kBufferSize];
-  const auto output = network->Propagate(transformed_features, buffer);
+      transformed_features[FeatureTransformerType::kBufferSize];
+  LocalFeatureTransformer<Architecture>(pos).Transform(
+      pos, transformed_features, refresh);
+  alignas(kCacheLineSize) char buffer[NetworkType::kBufferSize];
+  const auto output = LocalNetwork<Architecture>(pos).Propagate(
+      transformed_features, buffer);
 
   // When a value larger than VALUE_MAX_EVAL is returned, aspiration search fails high
   // It should be guaranteed that it is less than VALUE_MAX_EVAL because the search will not end.
@@ -173,89 +359,759 @@ static Value ComputeScore(const Position& pos, bool refresh = false) {
   return accumulator.score;
 }
 
-} // namespace NNUE
+// read the parameters of the second net of the ensemble (after the header)
+template <typename Architecture>
+bool ReadEnsembleParameters(std::istream& stream) {
+  Detail::Initialize(EnsembleParameters<Architecture>::feature_transformer);
+  Detail::Initialize(EnsembleParameters<Architecture>::network);
+  if (!Detail::ReadParameters(stream, EnsembleParameters<Architecture>::feature_transformer)) return false;
+  if (!Detail::ReadParameters(stream, EnsembleParameters<Architecture>::network)) return false;
+  return stream && stream.peek() == std::ios::traits_type::eof();
+}
 
-#if defined(USE_EVAL_HASH)
-// Class used to store evaluation values ​​in HashTable
-struct alignas(16) ScoreKeyValue {
-#if defined(USE_SSE2)
-  ScoreKeyValue() = default;
-  ScoreKeyValue(const ScoreKeyValue& other) {
-    static_assert(sizeof(ScoreKeyValue) == sizeof(__m128i),
-                  "sizeof(ScoreKeyValue) should be equal to sizeof(__m128i)");
-    _mm_store_si128(&as_m128i, other.as_m128i);
-  }
-  ScoreKeyValue& operator=(const ScoreKeyValue& other) {
-    _mm_store_si128(&as_m128i, other.as_m128i);
-    return *this;
+// Release the parameters of the second net of the ensemble
+template <typename Architecture>
+void ReleaseEnsemble() {
+  EnsembleParameters<Architecture>::feature_transformer.reset();
+  EnsembleParameters<Architecture>::network.reset();
+}
+
+// Calculate the evaluation value with the second net of the ensemble
+template <typename Architecture>
+Value ComputeEnsembleScore(const Position& pos) {
+  using FeatureTransformerType = BasicFeatureTransformer<Architecture>;
+  using NetworkType = typename Architecture::Network;
+  const auto& feature_transformer = EnsembleParameters<Architecture>::feature_transformer;
+
+  Thread* th = pos.this_thread();
+  alignas(kCacheLineSize) Accumulator accumulator;
+  feature_transformer->RefreshAccumulator(pos, accumulator,
+                                          th->nnueEnsembleRefreshCache);
+  alignas(kCacheLineSize) TransformedFeatureType
+      transformed_features[FeatureTransformerType::kBufferSize];
+  feature_transformer->Transform(accumulator, pos.side_to_move(),
+                                 transformed_features);
+  alignas(kCacheLineSize) char buffer[NetworkType::kBufferSize];
+  const auto output = EnsembleParameters<Architecture>::network->Propagate(
+      transformed_features, buffer);
+  th->nnueEnsembleEvaluations.fetch_add(1, std::memory_order_relaxed);
+
+  // Same scaling and clipping as ComputeScore()
+  auto score = static_cast<Value>(output[0] / FV_SCALE);
+  return Math::clamp(score, -VALUE_MAX_EVAL, VALUE_MAX_EVAL);
+}
+
+// Calculate the evaluation values of positions together
+// The network propagates up to kMaxBatchSize positions at a time, which turns
+// the matrix-vector products of the hidden layers into matrix-matrix products.
+template <typename Architecture>
+void EvaluateBatch(const Position* const* positions, std::size_t size,
+                   Value* scores) {
+  using FeatureTransformerType = BasicFeatureTransformer<Architecture>;
+  using NetworkType = typename Architecture::Network;
+  constexpr IndexType kTransformedStride = FeatureTransformerType::kBufferSize;
+  constexpr IndexType kOutputStride =
+      NetworkType::GetBatchStride(kTransformedStride);
+
+  alignas(kCacheLineSize) TransformedFeatureType
+      transformed_features[kMaxBatchSize * kTransformedStride];
+  alignas(kCacheLineSize) char buffer[kMaxBatchSize * NetworkType::kBufferSize];
+  for (std::size_t start = 0; start < size; start += kMaxBatchSize) {
+    const auto batch_size =
+        static_cast<IndexType>(std::min(size - start, kMaxBatchSize));
+    for (IndexType b = 0; b < batch_size; ++b) {
+      LocalFeatureTransformer<Architecture>(*positions[start + b]).Transform(
+          *positions[start + b], &transformed_features[b * kTransformedStride],
+          false);
+    }
+    const auto output = LocalNetwork<Architecture>(*positions[0]).PropagateBatch(
+        transformed_features, kTransformedStride, batch_size, buffer);
+
+    // Same scaling and clipping as ComputeScore()
+    for (IndexType b = 0; b < batch_size; ++b) {
+      auto score = static_cast<Value>(output[b * kOutputStride] / FV_SCALE);
+      score = Math::clamp(score, -VALUE_MAX_EVAL, VALUE_MAX_EVAL);
+      auto& accumulator = positions[start + b]->state()->accumulator;
+      accumulator.score = score;
+      accumulator.computed_score = true;
+      scores[start + b] = score;
+    }
   }
-#endif
+}
 
-  // It is necessary to be able to operate atomically with evaluate hash, so the manipulator for that
-  void encode() {
-#if defined(USE_SSE2)
-    // ScoreKeyValue is copied to atomic, so if the key matches, the data matches.
-#else
-    key ^= score;
-#endif
+// Measure the forward propagation of the network for the position
+// Returns the average time of a call to Propagate() (in nanoseconds) and
+// stores the sum of the outputs in checksum.
+template <typename Architecture>
+double BenchmarkPropagate(const Position& pos, std::uint64_t iterations,
+                          std::int64_t* checksum) {
+  using FeatureTransformerType = BasicFeatureTransformer<Architecture>;
+  using NetworkType = typename Architecture::Network;
+
+  alignas(kCacheLineSize) TransformedFeatureType
+      transformed_features[FeatureTransformerType::kBufferSize];
+  LocalFeatureTransformer<Architecture>(pos).Transform(
+      pos, transformed_features, true);
+  alignas(kCacheLineSize) char buffer[NetworkType::kBufferSize];
+  const auto& network = LocalNetwork<Architecture>(pos);
+
+  // Change one input per call so that the calls can not be folded
+  const auto original = transformed_features[0];
+  std::int64_t sum = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (std::uint64_t i = 0; i < iterations; ++i) {
+    transformed_features[0] = static_cast<TransformedFeatureType>(original ^ (i & 1));
+    sum += network.Propagate(transformed_features, buffer)[0];
   }
-  // decode() is the reverse conversion of encode(), but since it is xor, the reverse conversion is the same.
-  void decode() { encode(); }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
 
-  union {
-    struct {
-      std::uint64_t key;
-      std::uint64_t score;
-    };
-#if defined(USE_SSE2)
-    __m128i as_m128i;
-#endif
-  };
+  *checksum = sum;
+  return std::chrono::duration<double, std::nano>(elapsed).count()
+       / std::max<std::uint64_t>(iterations, 1);
+}
+
+// Evaluate the position like ComputeScore() and add the cycles spent in the
+// feature transformer and in each layer of the network to profile
+template <typename Architecture>
+Value ProfilePosition(const Position& pos, bool refresh,
+                      EvaluationProfile* profile) {
+  using FeatureTransformerType = BasicFeatureTransformer<Architecture>;
+  using NetworkType = typename Architecture::Network;
+  const auto& feature_transformer = LocalFeatureTransformer<Architecture>(pos);
+
+  if (profile->layers.size() != NetworkType::kNumLayers) {
+    std::vector<std::string> names;
+    NetworkType::AppendLayerNames(&names);
+    profile->layers.assign(names.size(), ProfileEntry());
+    for (std::size_t i = 0; i < names.size(); ++i) {
+      profile->layers[i].name = names[i];
+    }
+  }
+
+  auto start = ReadTimestampCounter();
+  if (!refresh && feature_transformer.UpdateAccumulatorIfPossible(pos)) {
+    ++profile->update.calls;
+    profile->update.cycles += ReadTimestampCounter() - start;
+  } else {
+    start = ReadTimestampCounter();
+    feature_transformer.RefreshAccumulator(pos);
+    ++profile->refresh.calls;
+    profile->refresh.cycles += ReadTimestampCounter() - start;
+  }
+
+  // The accumulator is computed, so Transform() only converts it
+  alignas(kCacheLineSize) TransformedFeatureType
+      transformed_features[FeatureTransformerType::kBufferSize];
+  start = ReadTimestampCounter();
+  feature_transformer.Transform(pos, transformed_features, false);
+  ++profile->transform.calls;
+  profile->transform.cycles += ReadTimestampCounter() - start;
+
+  alignas(kCacheLineSize) char buffer[NetworkType::kBufferSize];
+  std::uint64_t cycles[NetworkType::kNumLayers] = {};
+  const auto output = LocalNetwork<Architecture>(pos).PropagateProfiled(
+      transformed_features, buffer, cycles);
+  for (IndexType i = 0; i < NetworkType::kNumLayers; ++i) {
+    ++profile->layers[i].calls;
+    profile->layers[i].cycles += cycles[i];
+  }
+
+  // Same scaling and clipping as ComputeScore()
+  auto score = static_cast<Value>(output[0] / FV_SCALE);
+  score = Math::clamp(score, -VALUE_MAX_EVAL, VALUE_MAX_EVAL);
+  auto& accumulator = pos.state()->accumulator;
+  accumulator.score = score;
+  accumulator.computed_score = true;
+  return score;
+}
+
+// Entry points of one architecture.
+// Every function is fully specialized for its architecture, so switching
+// architectures costs a single indirect call per evaluation.
+struct ArchitectureFunctions {
+  std::uint32_t hash_value;
+  std::string (*get_architecture_string)();
+  void (*initialize)();
+  void (*release)();
+  bool (*read_parameters)(std::istream&);
+  bool (*write_parameters)(std::ostream&);
+  bool (*read_image)(std::istream&, std::uint64_t, const ImageLayout&, char*, std::size_t);
+  bool (*write_image)(std::ostream&);
+  IndexType (*compress_feature_weights)();
+  void (*release_compressed_feature_weights)();
+  void (*replicate_parameters)(int);
+  void (*update_accumulator_if_possible)(const Position&);
+  Value (*compute_score)(const Position&, bool);
+  bool (*read_ensemble_parameters)(std::istream&);
+  void (*release_ensemble)();
+  Value (*compute_ensemble_score)(const Position&);
+  void (*evaluate_batch)(const Position* const*, std::size_t, Value*);
+  double (*benchmark_propagate)(const Position&, std::uint64_t, std::int64_t*);
+  Value (*profile_position)(const Position&, bool, EvaluationProfile*);
 };
 
-// Simple HashTable implementation.
-// Size is a power of 2.
-template <typename T, size_t Size>
-struct HashTable {
-  HashTable() { clear(); }
-  T* operator [] (const Key k) { return entries_ + (static_cast<size_t>(k) & (Size - 1)); }
-  void clear() { memset(entries_, 0, sizeof(T)*Size); }
+template <typename Architecture>
+constexpr ArchitectureFunctions MakeArchitectureFunctions() {
+  return {
+    GetHashValue<Architecture>(),
+    &GetArchitectureString<Architecture>,
+    &Initialize<Architecture>,
+    &Release<Architecture>,
+    &ReadParameters<Architecture>,
+    &WriteParameters<Architecture>,
+    &ReadImage<Architecture>,
+    &WriteImage<Architecture>,
+    &CompressFeatureWeights<Architecture>,
+    &ReleaseCompressedFeatureWeights<Architecture>,
+    &ReplicateParameters<Architecture>,
+    &UpdateAccumulatorIfPossible<Architecture>,
+    &ComputeScore<Architecture>,
+    &ReadEnsembleParameters<Architecture>,
+    &ReleaseEnsemble<Architecture>,
+    &ComputeEnsembleScore<Architecture>,
+    &EvaluateBatch<Architecture>,
+    &BenchmarkPropagate<Architecture>,
+    &ProfilePosition<Architecture>,
+  };
+}
+
+template <typename... ArchitectureTypes>
+constexpr std::array<ArchitectureFunctions, sizeof...(ArchitectureTypes)>
+MakeArchitectureTable(ArchitectureList<ArchitectureTypes...>) {
+  return {{MakeArchitectureFunctions<ArchitectureTypes>()...}};
+}
+
+// Entry points of all supported architectures
+constexpr auto kArchitectures = MakeArchitectureTable(SupportedArchitectures());
+
+constexpr ArchitectureFunctions kDefaultArchitecture =
+    MakeArchitectureFunctions<DefaultArchitecture>();
+
+// Architecture in use
+const ArchitectureFunctions* active_architecture = &kDefaultArchitecture;
+
+// Architecture of the second net of the ensemble, if one is loaded
+const ArchitectureFunctions* ensemble_architecture = nullptr;
+
+// Find a supported architecture from the file header
+// Some feature sets share a hash value (e.g. HalfKPKfile and HalfKPKrank),
+// so the architecture string decides between them.
+const ArchitectureFunctions* FindArchitecture(std::uint32_t hash_value,
+                                              const std::string& architecture) {
+  const ArchitectureFunctions* found = nullptr;
+  int num_found = 0;
+  for (const auto& functions : kArchitectures) {
+    if (functions.hash_value != hash_value) continue;
+    if (functions.get_architecture_string() == architecture) {
+      return &functions;
+    }
+    found = &functions;
+    ++num_found;
+  }
+  return num_found == 1 ? found : nullptr;
+}
+
+// Hash value of the feature transformer of a HalfKPE4 variant in the nets written
+// before the variants had distinct hash values and names
+template <typename Architecture>
+constexpr std::uint32_t GetLegacyHalfKPE4FeatureHashValue() {
+  return BasicFeatureTransformer<Architecture>::GetHashValue() ^
+         Architecture::RawFeatures::kHashValue ^ Features::kLegacyHalfKPE4HashValue;
+}
+
+// Hash value of the header of those nets, which is the same for all variants
+constexpr std::uint32_t kLegacyHalfKPE4HashValue =
+    GetLegacyHalfKPE4FeatureHashValue<Architectures::HalfKPE4AA_256x2_32_32>() ^
+    Architectures::HalfKPE4AA_256x2_32_32::Network::GetHashValue();
+
+// Rewrite a HalfKPE4 net written before the variants had distinct hash values and
+// names (after its header) as a net of the given variant. Only the hash values and
+// the architecture string change, the parameters are copied as they are.
+template <typename Architecture>
+bool RewriteLegacyHalfKPE4(std::istream& input, std::ostream& output) {
+  std::uint32_t header;
+  input.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!input || header != GetLegacyHalfKPE4FeatureHashValue<Architecture>()) return false;
+  if (!WriteHeader(output, GetHashValue<Architecture>(),
+                   GetArchitectureString<Architecture>())) return false;
+  header = BasicFeatureTransformer<Architecture>::GetHashValue();
+  output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  output << input.rdbuf();
+  return !output.fail();
+}
+
+// Release the parameters in use, including the mapping of an image
+void ReleaseParameters() {
+  active_architecture->release();
+  unmap_file(mapped_image, mapped_image_size);
+  mapped_image = nullptr;
+  mapped_image_size = 0;
+}
+
+// Make the architecture the one in use (its parameters are set up by the caller)
+void SetActiveArchitecture(const ArchitectureFunctions& functions) {
+  active_architecture = &functions;
+}
+
+// Make the architecture the one in use and allocate its parameters
+// Parameters already allocated for it are kept so that the learner can reread them
+void Activate(const ArchitectureFunctions& functions) {
+  // kDefaultArchitecture and its entry in kArchitectures share the same functions
+  if (active_architecture->get_architecture_string ==
+      functions.get_architecture_string && !mapped_image) {
+    return;
+  }
+  ReleaseParameters();
+  functions.initialize();
+  SetActiveArchitecture(functions);
+}
+
+}  // namespace
+
+// Get a string that represents the structure of the architecture in use
+std::string GetArchitectureString() {
+  return active_architecture->get_architecture_string();
+}
+
+// Get the structure string of the supported architecture matching the file header
+bool FindArchitecture(std::uint32_t hash_value, const std::string& architecture,
+                      std::string* supported_architecture) {
+  const auto functions = FindArchitecture(hash_value, architecture);
+  if (!functions) return false;
+  *supported_architecture = functions->get_architecture_string();
+  return true;
+}
+
+// Get the structure strings of all the architectures supported by this binary
+std::vector<std::string> GetSupportedArchitectureStrings() {
+  std::vector<std::string> architectures;
+  for (const auto& functions : kArchitectures) {
+    architectures.push_back(functions.get_architecture_string());
+  }
+  return architectures;
+}
+
+// Get the structure string of the supported architecture of an evaluation function file
+bool GetFileArchitectureString(const std::string& file_name,
+                               std::string* architecture) {
+  std::ifstream stream(file_name, std::ios::binary);
+  std::uint32_t hash_value;
+  std::string file_architecture;
+  if (!Detail::ReadHeader(stream, IsImageFile(file_name) ? kImageVersion : kVersion,
+                          &hash_value, &file_architecture)) return false;
+  const auto functions = FindArchitecture(hash_value, file_architecture);
+  if (!functions) return false;
+  *architecture = functions->get_architecture_string();
+  return true;
+}
+
+// Check whether the header is that of a HalfKPE4 net written before the variants
+// had distinct hash values and names
+bool IsLegacyHalfKPE4(std::uint32_t hash_value, const std::string& architecture) {
+  return hash_value == kLegacyHalfKPE4HashValue &&
+      architecture.find(std::string(Features::kLegacyHalfKPE4Name) + "[") != std::string::npos;
+}
+
+// Check whether the evaluation function file (.bin or image) is such a net
+bool IsLegacyHalfKPE4File(const std::string& file_name) {
+  std::ifstream stream(file_name, std::ios::binary);
+  std::uint32_t hash_value;
+  std::string architecture;
+  return Detail::ReadHeader(stream, IsImageFile(file_name) ? kImageVersion : kVersion,
+                            &hash_value, &architecture) &&
+      IsLegacyHalfKPE4(hash_value, architecture);
+}
+
+// Rewrite such a net as a net of the variant given by its effect types ("AA", "AS", "SA" or "SS")
+bool RewriteLegacyHalfKPE4(std::istream& input, std::ostream& output,
+                           const std::string& variant) {
+  std::uint32_t hash_value;
+  std::string architecture;
+  if (!ReadHeader(input, &hash_value, &architecture)) return false;
+  if (!IsLegacyHalfKPE4(hash_value, architecture)) return false;
+  if (variant == "AA")
+    return RewriteLegacyHalfKPE4<Architectures::HalfKPE4AA_256x2_32_32>(input, output);
+  if (variant == "AS")
+    return RewriteLegacyHalfKPE4<Architectures::HalfKPE4AS_256x2_32_32>(input, output);
+  if (variant == "SA")
+    return RewriteLegacyHalfKPE4<Architectures::HalfKPE4SA_256x2_32_32>(input, output);
+  if (variant == "SS")
+    return RewriteLegacyHalfKPE4<Architectures::HalfKPE4SS_256x2_32_32>(input, output);
+  return false;
+}
 
-  // Check that Size is a power of 2
-  static_assert((Size & (Size - 1)) == 0, "");
+// Initialize the parameters of the default architecture and make it the one in use
+void Initialize() {
+  ReleaseParameters();
+  kDefaultArchitecture.initialize();
+  SetActiveArchitecture(kDefaultArchitecture);
+}
+
+// Clear the refresh caches of all threads
+void ClearRefreshCaches() {
+  for (Thread* th : Threads) {
+    th->nnueRefreshCache.clear();
+    th->nnueEnsembleRefreshCache.clear();
+  }
+}
+
+// read the second net of the ensemble
+bool ReadEnsembleParameters(std::istream& stream) {
+  ReleaseEnsemble();
+  std::uint32_t hash_value;
+  std::string architecture;
+  if (!ReadHeader(stream, &hash_value, &architecture)) return false;
+  const auto functions = FindArchitecture(hash_value, architecture);
+  if (!functions) return false;
+  ensemble_architecture = functions;
+  if (!functions->read_ensemble_parameters(stream)) {
+    ReleaseEnsemble();
+    return false;
+  }
+  return true;
+}
+
+// Release the second net of the ensemble
+void ReleaseEnsemble() {
+  if (ensemble_architecture) {
+    ensemble_architecture->release_ensemble();
+    ensemble_architecture = nullptr;
+  }
+}
+
+// Whether a second net is loaded
+bool HasEnsemble() {
+  return ensemble_architecture != nullptr;
+}
+
+// Get a string that represents the structure of the second net
+std::string GetEnsembleArchitectureString() {
+  return ensemble_architecture ? ensemble_architecture->get_architecture_string() : "";
+}
+
+// Whether the second net has the architecture of the net in use
+bool EnsembleSharesArchitecture() {
+  return ensemble_architecture &&
+         ensemble_architecture->get_architecture_string ==
+             active_architecture->get_architecture_string;
+}
+
+// Evaluate the position with the second net of the ensemble
+Value ComputeEnsembleScore(const Position& pos) {
+  return ensemble_architecture->compute_ensemble_score(pos);
+}
+
+// read the header
+bool ReadHeader(std::istream& stream,
+  std::uint32_t* hash_value, std::string* architecture) {
+  return Detail::ReadHeader(stream, kVersion, hash_value, architecture);
+}
+
+// write the header
+bool WriteHeader(std::ostream& stream,
+  std::uint32_t hash_value, const std::string& architecture) {
+  return Detail::WriteHeader(stream, kVersion, hash_value, architecture);
+}
+
+// read evaluation function parameters
+bool ReadParameters(std::istream& stream) {
+  std::uint32_t hash_value;
+  std::string architecture;
+  if (!ReadHeader(stream, &hash_value, &architecture)) return false;
+  const auto functions = FindArchitecture(hash_value, architecture);
+  if (!functions) return false;
+  Activate(*functions);
+  return functions->read_parameters(stream);
+}
+
+// write evaluation function parameters
+bool WriteParameters(std::ostream& stream) {
+  return active_architecture->write_parameters(stream);
+}
+
+// Check whether the file is an aligned image of the evaluation function
+bool IsImageFile(const std::string& file_name) {
+  std::ifstream stream(file_name, std::ios::binary);
+  std::uint32_t version = 0;
+  stream.read(reinterpret_cast<char*>(&version), sizeof(version));
+  return stream && version == kImageVersion;
+}
+
+// read an aligned image of the evaluation function
+bool ReadImage(const std::string& file_name, bool map) {
+  std::ifstream stream(file_name, std::ios::binary);
+  std::uint32_t hash_value;
+  std::string architecture;
+  ImageLayout layout;
+  if (!Detail::ReadHeader(stream, kImageVersion, &hash_value, &architecture)) return false;
+  stream.read(reinterpret_cast<char*>(&layout), sizeof(layout));
+  if (!stream) return false;
+  const auto functions = FindArchitecture(hash_value, architecture);
+  if (!functions) return false;
+
+  ReleaseParameters();
+  SetActiveArchitecture(*functions);
+  if (map) {
+    // Fall back to reading the image if the file cannot be mapped
+    mapped_image = map_file(file_name, mapped_image_size);
+  }
+  return functions->read_image(stream, Detail::HeaderSize(architecture), layout,
+                               static_cast<char*>(mapped_image), mapped_image_size);
+}
+
+// write the evaluation function parameters in use as an aligned image
+bool WriteImage(std::ostream& stream) {
+  return active_architecture->write_image(stream);
+}
+
+// Whether the parameters in use are a read-only mapping of an image
+bool IsMapped() {
+  return mapped_image != nullptr;
+}
+
+// Keep an int8 copy of the weights of the feature transformer in use if they fit
+IndexType CompressFeatureWeights() {
+  return active_architecture->compress_feature_weights();
+}
+
+// Drop the int8 copy of the weights of the feature transformer in use
+void ReleaseCompressedFeatureWeights() {
+  active_architecture->release_compressed_feature_weights();
+}
+
+// Copy the parameters in use to each NUMA node
+int ReplicateParameters() {
+  const int num_nodes = Numa::node_count();
+  active_architecture->replicate_parameters(num_nodes > 1 ? num_nodes : 0);
+  return num_nodes > 1 ? num_nodes : 0;
+}
+
+// Drop the copies of the parameters in use made by ReplicateParameters()
+void ReleaseReplicas() {
+  active_architecture->replicate_parameters(0);
+}
+
+// Measure the forward propagation of the network in use (nanoseconds per call)
+double BenchmarkPropagate(const Position& pos, std::uint64_t iterations,
+                          std::int64_t* checksum) {
+  return active_architecture->benchmark_propagate(pos, iterations, checksum);
+}
+
+// Calculate the evaluation values of positions together
+void EvaluateBatch(const Position* const* positions, std::size_t size,
+                   Value* scores) {
+  active_architecture->evaluate_batch(positions, size, scores);
+}
+
+// proceed if you can calculate the difference
+static void UpdateAccumulatorIfPossible(const Position& pos) {
+  active_architecture->update_accumulator_if_possible(pos);
+}
+
+// Calculate the evaluation value
+static Value ComputeScore(const Position& pos, bool refresh = false) {
+  return active_architecture->compute_score(pos, refresh);
+}
+
+} // namespace NNUE
+
+#if defined(USE_EVAL_HASH)
+// HashTable to save the evaluated ones (following ehash)
+// The table consists of a power of 2 number of buckets, each of which fills a cache line.
+// An entry packs the upper 32 bits of the key (the lower bits select the bucket) and the
+// score into 64 bits, so that it is read and written with a single access and threads
+// never see an entry torn by a concurrent write. A store overwrites the entry of the same
+// key or an empty one, and otherwise a single entry chosen by the key, so that a bucket
+// shared by all threads is written only once per store.
+class EvaluateHashTable {
+
+  static constexpr int kBucketSize = 8;
+
+  struct alignas(64) Bucket {
+    std::uint64_t entries[kBucketSize];
+  };
+  static_assert(sizeof(Bucket) == 64, "Bucket size incorrect");
+
+ public:
+  ~EvaluateHashTable() { aligned_ttmem_free(mem_); }
+
+  // The table is disabled when its size is 0
+  bool enabled() const { return table_ != nullptr; }
+
+  void resize(size_t mbSize);
+  void clear();
+
+  Bucket* bucket(const Key key) const {
+    return &table_[static_cast<size_t>(key) & (bucketCount_ - 1)];
+  }
+
+  bool probe(const Key key, Value* score) const {
+    const std::uint64_t check = key >> 32;
+    for (const std::uint64_t entry : bucket(key)->entries)
+      if ((entry >> 32) == check && entry != 0) {
+        *score = static_cast<Value>(static_cast<std::int32_t>(entry));
+        return true;
+      }
+    return false;
+  }
+
+  void store(const Key key, Value score) {
+    const std::uint64_t check = key >> 32;
+    std::uint64_t* entries = bucket(key)->entries;
+    std::uint64_t* replace = &entries[check & (kBucketSize - 1)];
+    for (int i = 0; i < kBucketSize; ++i)
+      if ((entries[i] >> 32) == check || entries[i] == 0) {
+        replace = &entries[i];
+        break;
+      }
+    *replace = (check << 32) | static_cast<std::uint32_t>(score);
+  }
 
  private:
-  T entries_[Size];
+  Bucket* table_ = nullptr;
+  size_t bucketCount_ = 0;
+  void* mem_ = nullptr;
 };
 
-//HashTable to save the evaluated ones (following ehash)
+// Set the size of the table, measured in megabytes and rounded down to a power of 2.
+// The memory comes from aligned_ttmem_alloc() so that large pages are used when available.
+void EvaluateHashTable::resize(size_t mbSize) {
 
-#if !defined(USE_LARGE_EVAL_HASH)
-// 134MB (setting other than witch's AVX2)
-struct EvaluateHashTable : HashTable<ScoreKeyValue, 0x800000> {};
-#else
-// If you have prefetch, it's better to have a big one...
-// → It doesn't change much and the memory is wasteful, so is it okay to set ↑ by default?
-// 1GB (setting for witch's AVX2)
-struct EvaluateHashTable : HashTable<ScoreKeyValue, 0x4000000> {};
-#endif
+  Threads.main()->wait_for_search_finished();
+
+  aligned_ttmem_free(mem_);
+  table_ = nullptr;
+  bucketCount_ = 0;
+  mem_ = nullptr;
+
+  if (mbSize == 0)
+      return;
+
+  while (mbSize & (mbSize - 1))
+      mbSize &= mbSize - 1;
+
+  bucketCount_ = mbSize * 1024 * 1024 / sizeof(Bucket);
+  table_ = static_cast<Bucket*>(aligned_ttmem_alloc(bucketCount_ * sizeof(Bucket), mem_));
+  if (!mem_)
+  {
+      std::cerr << "Failed to allocate " << mbSize
+                << "MB for eval hash." << std::endl;
+      exit(EXIT_FAILURE);
+  }
+
+  clear();
+}
+
+void EvaluateHashTable::clear() {
+  if (table_)
+      std::memset(table_, 0, bucketCount_ * sizeof(Bucket));
+}
 
 EvaluateHashTable g_evalTable;
 
-// Prepare a function to prefetch.
-void prefetch_evalhash(const Key key) {
-  constexpr auto mask = ~((uint64_t)0x1f);
-  prefetch((void*)((uint64_t)g_evalTable[key] & mask));
+// With EvalHashPerNode, a table of EvalHash MB on each NUMA node, used by the
+// threads bound to the node in place of g_evalTable
+std::vector<std::unique_ptr<EvaluateHashTable>> g_nodeEvalTables;
+
+// Table read and written by the thread of the position
+EvaluateHashTable& local_evalhash(const Position& pos) {
+  const Thread* th = pos.this_thread();
+  return th && size_t(th->numaNode) < g_nodeEvalTables.size() ?
+      *g_nodeEvalTables[th->numaNode] : g_evalTable;
+}
+
+// Prefetch the eval hash bucket that evaluate() reads after the last move
+void prefetch_evaluation(const Position& pos) {
+  const auto& evalTable = local_evalhash(pos);
+  if (evalTable.enabled())
+      prefetch(evalTable.bucket(pos.key()));
+}
+
+// Each table of EvalHashPerNode is allocated and cleared by a thread bound to
+// its node, so that its pages are allocated there.
+void resize_evalhash(size_t mbSize) {
+  g_nodeEvalTables.clear();
+  const int nodes = Numa::node_count();
+  if (!Options["EvalHashPerNode"] || nodes == 1)
+  {
+      g_evalTable.resize(mbSize);
+      return;
+  }
+
+  g_evalTable.resize(0);
+  for (int node = 0; node < nodes; ++node)
+  {
+      g_nodeEvalTables.emplace_back(new EvaluateHashTable);
+      Numa::run_on_node(node, [&] { g_nodeEvalTables.back()->resize(mbSize); });
+  }
+}
+
+void clear_evalhash() {
+  g_evalTable.clear();
+  for (auto& table : g_nodeEvalTables)
+      table->clear();
 }
 #endif
 
+namespace NNUE {
+
+// Evaluate the position and add the cycles spent in each step to profile
+Value ProfileEvaluation(const Position& pos, bool refresh,
+                        EvaluationProfile* profile) {
+#if defined(USE_EVAL_HASH)
+  const Key key = pos.key();
+  auto& evalTable = local_evalhash(pos);
+  if (evalTable.enabled()) {
+    Value hashed_score;
+    const auto start = ReadTimestampCounter();
+    const bool hit = evalTable.probe(key, &hashed_score);
+    ++profile->eval_hash_probe.calls;
+    profile->eval_hash_probe.cycles += ReadTimestampCounter() - start;
+    profile->eval_hash_hits += hit;
+  }
+#endif
+
+  const Value score = active_architecture->profile_position(pos, refresh, profile);
+
+#if defined(USE_EVAL_HASH)
+  if (evalTable.enabled()) {
+    const auto start = ReadTimestampCounter();
+    evalTable.store(key, score);
+    ++profile->eval_hash_store.calls;
+    profile->eval_hash_store.cycles += ReadTimestampCounter() - start;
+  }
+#endif
+  return score;
+}
+
+}  // namespace NNUE
+
+// HalfKPE4 nets written before the variants had distinct hash values are not
+// loaded, since reading them as the wrong variant gives wrong evaluations.
+static void print_legacy_halfkpe4_hint(const std::string& file_name) {
+  if (NNUE::IsLegacyHalfKPE4File(file_name))
+      std::cout << "info string " << file_name << " is a HalfKPE4 net written before the "
+                << "variants had distinct hash values, rewrite it with "
+                << "\"test nnue rewrite_halfkpe4 " << file_name << " <output> AA|AS|SA|SS\""
+                << " (nnue-learn build)" << std::endl;
+}
+
 // read the evaluation function file
 // Save and restore Options with bench command etc., so EvalDir is changed at this time,
 // This function may be called twice to flag that the evaluation function needs to be reloaded.
 void load_eval() {
 
   // Must be done!
+  // The default architecture is used until a file of another architecture is read.
   NNUE::Initialize();
+  NNUE::ReleaseEnsemble();
+  update_ensemble_policy();
+
+#if defined(USE_EVAL_HASH)
+  // The values stored in the eval hash were computed by the previous parameters
+  clear_evalhash();
+#endif
+  NNUE::ClearRefreshCaches();
 
   if (Options["SkipLoadingEval"])
   {
@@ -266,15 +1122,61 @@ void load_eval() {
   const std::string file_name = Options["EvalFile"];
   NNUE::fileName = file_name;
 
-  std::ifstream stream(file_name, std::ios::binary);
-  const bool result = NNUE::ReadParameters(stream);
+  bool result;
+  if (NNUE::IsImageFile(file_name))
+      result = NNUE::ReadImage(file_name, Options["EvalFileMmap"]);
+  else
+  {
+      std::ifstream stream(file_name, std::ios::binary);
+      result = NNUE::ReadParameters(stream);
+  }
 
   if (!result)
+  {
+      // Do not keep the parameters of a partially read file
+      NNUE::Initialize();
+
       // It's a problem if it doesn't finish when there is a read error.
       std::cout << "Error! " << NNUE::fileName << " not found or wrong format" << std::endl;
-
+      print_legacy_halfkpe4_hint(file_name);
+  }
   else
-      std::cout << "info string NNUE " << NNUE::fileName << " found & loaded" << std::endl;
+  {
+      std::cout << "info string NNUE " << NNUE::fileName << " found & loaded ("
+                << NNUE::GetArchitectureString() << ")"
+                << (NNUE::IsMapped() ? " (mapped)" : "") << std::endl;
+
+      if (Options["EvalNumaReplication"] && NNUE::ReplicateParameters())
+          std::cout << "info string NNUE parameters copied to "
+                    << Numa::node_count() << " NUMA nodes" << std::endl;
+
+      const std::string ensemble_file = Options["EnsembleEvalFile"];
+      if (!ensemble_file.empty() && ensemble_file != "<empty>")
+      {
+          std::ifstream ensemble_stream(ensemble_file, std::ios::binary);
+          if (NNUE::ReadEnsembleParameters(ensemble_stream))
+              std::cout << "info string NNUE ensemble " << ensemble_file << " found & loaded ("
+                        << NNUE::GetEnsembleArchitectureString() << ")" << std::endl;
+          else
+          {
+              std::cout << "Error! " << ensemble_file << " not found or wrong format" << std::endl;
+              print_legacy_halfkpe4_hint(ensemble_file);
+          }
+      }
+
+      if (Options["EvalCompressWeights"])
+      {
+          if (NNUE::EnsembleSharesArchitecture())
+              std::cout << "info string NNUE feature weights not compressed, "
+                        << "the ensemble net has the same architecture" << std::endl;
+          else if (const auto compressed = NNUE::CompressFeatureWeights())
+              std::cout << "info string NNUE feature weights of " << compressed
+                        << " features stored as int8 with a scale per feature, "
+                        << "the others as int16" << std::endl;
+          else
+              std::cout << "info string NNUE feature weights do not fit in int8, using int16" << std::endl;
+      }
+  }
 }
 
 // Initialization
@@ -306,26 +1208,69 @@ Value evaluate(const Position& pos) {
 #endif
 
 #if defined(USE_EVAL_HASH)
+  auto& evalTable = local_evalhash(pos);
+  if (!evalTable.enabled())
+    return NNUE::ComputeScore(pos);
+
   // May be in the evaluate hash table.
   const Key key = pos.key();
-  ScoreKeyValue entry = *g_evalTable[key];
-  entry.decode();
-  if (entry.key == key) {
+  Value score;
+  if (evalTable.probe(key, &score)) {
     // there were!
-    return Value(entry.score);
+    pos.this_thread()->evalHashHits.fetch_add(1, std::memory_order_relaxed);
+    return score;
   }
-#endif
+  pos.this_thread()->evalHashMisses.fetch_add(1, std::memory_order_relaxed);
 
-  Value score = NNUE::ComputeScore(pos);
-#if defined(USE_EVAL_HASH)
+  score = NNUE::ComputeScore(pos);
   // Since it was calculated carefully, save it in the evaluate hash table.
-  entry.key = key;
-  entry.score = score;
-  entry.encode();
-  *g_evalTable[key] = entry;
+  evalTable.store(key, score);
+  return score;
+#else
+  return NNUE::ComputeScore(pos);
 #endif
+}
 
-  return score;
+namespace {
+
+// When the second net of the ensemble is evaluated, and its share of the result
+struct EnsemblePolicy {
+  bool pv = true;      // at PV nodes
+  int margin = 0;      // when the absolute value of the first net is below it
+  int weightMg = 100;  // share of the second net in percent, in the midgame
+  int weightEg = 100;  // and in the endgame, interpolated by the game phase
+};
+
+EnsemblePolicy ensemblePolicy;
+
+} // namespace
+
+// Read the escalation policy of the ensemble from the UCI options
+void update_ensemble_policy() {
+  ensemblePolicy.pv = Options["EnsemblePV"];
+  ensemblePolicy.margin = int(Options["EnsembleMargin"]);
+  ensemblePolicy.weightMg = int(Options["EnsembleWeightMg"]);
+  ensemblePolicy.weightEg = int(Options["EnsembleWeightEg"]);
+}
+
+// Evaluation function used by the search
+// The first net is evaluated everywhere. With a second net (EnsembleEvalFile),
+// its value is blended in at PV nodes and when that of the first net is within
+// EnsembleMargin of 0. The eval hash only holds values of the first net.
+Value evaluate(const Position& pos, bool pvNode) {
+  const Value value = evaluate(pos);
+  if (!NNUE::HasEnsemble() ||
+      !((pvNode && ensemblePolicy.pv) || std::abs(value) < ensemblePolicy.margin))
+    return value;
+
+  const Value ensembleValue = NNUE::ComputeEnsembleScore(pos);
+
+  // Map the non-pawn material into [PHASE_ENDGAME, PHASE_MIDGAME] as Material::probe() does
+  const Value npm = Math::clamp(pos.non_pawn_material(), EndgameLimit, MidgameLimit);
+  const int phase = ((npm - EndgameLimit) * PHASE_MIDGAME) / (MidgameLimit - EndgameLimit);
+  const int weight = (ensemblePolicy.weightMg * phase
+                    + ensemblePolicy.weightEg * (PHASE_MIDGAME - phase)) / PHASE_MIDGAME;
+  return Value((value * (100 - weight) + ensembleValue * weight) / 100);
 }
 
 // proceed if you can calculate the difference
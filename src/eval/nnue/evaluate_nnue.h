@@ -9,31 +9,66 @@
 #include "nnue_architecture.h"
 
 #include <memory>
+#include <vector>
 
 namespace Eval {
 
 namespace NNUE {
 
 // hash value of evaluation function structure
-constexpr std::uint32_t kHashValue =
-    FeatureTransformer::GetHashValue() ^ Network::GetHashValue();
+template <typename Architecture>
+constexpr std::uint32_t GetHashValue() {
+  return BasicFeatureTransformer<Architecture>::GetHashValue() ^
+         Architecture::Network::GetHashValue();
+}
+
+// hash value of the default architecture
+constexpr std::uint32_t kHashValue = GetHashValue<DefaultArchitecture>();
 
 // Deleter for automating release of memory area
+// Objects placed in a mapped evaluation function image are not owned
 template <typename T>
 struct AlignedDeleter {
+  bool owns_memory = true;
+  bool large_pages = false;  // allocated by aligned_large_pages_alloc()
   void operator()(T* ptr) const {
+    if (!owns_memory) return;
     ptr->~T();
-    aligned_free(ptr);
+    if (large_pages) aligned_large_pages_free(ptr, sizeof(T));
+    else aligned_free(ptr);
   }
 };
 template <typename T>
 using AlignedPtr = std::unique_ptr<T, AlignedDeleter<T>>;
 
-// Input feature converter
-extern AlignedPtr<FeatureTransformer> feature_transformer;
+// Evaluation function parameters of each architecture
+// Memory is allocated only for the architecture in use
+template <typename Architecture>
+struct Parameters {
+  // Input feature converter
+  static inline AlignedPtr<BasicFeatureTransformer<Architecture>>
+      feature_transformer;
+
+  // Evaluation function
+  static inline AlignedPtr<typename Architecture::Network> network;
+
+  // Copies of the parameters allocated on each NUMA node by ReplicateParameters()
+  // The threads bound to a node read its copy instead of the parameters above.
+  struct Replica {
+    AlignedPtr<BasicFeatureTransformer<Architecture>> feature_transformer;
+    AlignedPtr<typename Architecture::Network> network;
+  };
+  static inline std::vector<Replica> replicas;
+};
 
-// Evaluation function
-extern AlignedPtr<Network> network;
+// Parameters of the second net of the ensemble (EnsembleEvalFile)
+// Kept apart from Parameters so that both nets may have the same architecture.
+template <typename Architecture>
+struct EnsembleParameters {
+  static inline AlignedPtr<BasicFeatureTransformer<Architecture>>
+      feature_transformer;
+  static inline AlignedPtr<typename Architecture::Network> network;
+};
 
 // Evaluation function file name
 extern std::string fileName;
@@ -42,8 +77,44 @@ extern std::string fileName;
 extern std::string savedfileName;
 
 // Get a string that represents the structure of the evaluation function
+template <typename Architecture>
+std::string GetArchitectureString() {
+  return "Features=" +
+      BasicFeatureTransformer<Architecture>::GetStructureString() +
+      ",Network=" + Architecture::Network::GetStructureString();
+}
+
+// Get a string that represents the structure of the architecture in use
 std::string GetArchitectureString();
 
+// Get the structure string of the supported architecture matching the file header
+bool FindArchitecture(std::uint32_t hash_value, const std::string& architecture,
+                      std::string* supported_architecture);
+
+// Get the structure strings of all the architectures supported by this binary
+std::vector<std::string> GetSupportedArchitectureStrings();
+
+// Get the structure string of the supported architecture of an evaluation
+// function file (.bin or image) from its header, without reading the parameters
+bool GetFileArchitectureString(const std::string& file_name,
+                               std::string* architecture);
+
+// Check whether the header is that of a HalfKPE4 net written before the variants
+// (AA, AS, SA, SS) had distinct hash values and names. Such a net is not loaded,
+// since its variant is unknown.
+bool IsLegacyHalfKPE4(std::uint32_t hash_value, const std::string& architecture);
+
+// Check whether the evaluation function file (.bin or image) is such a net
+bool IsLegacyHalfKPE4File(const std::string& file_name);
+
+// Rewrite such a net (.bin) as a net of the variant given by its effect types
+// ("AA", "AS", "SA" or "SS")
+bool RewriteLegacyHalfKPE4(std::istream& input, std::ostream& output,
+                           const std::string& variant);
+
+// Initialize the parameters of the default architecture and make it the one in use
+void Initialize();
+
 // read the header
 bool ReadHeader(std::istream& stream,
     std::uint32_t* hash_value, std::string* architecture);
@@ -53,11 +124,111 @@ bool WriteHeader(std::ostream& stream,
     std::uint32_t hash_value, const std::string& architecture);
 
 // read evaluation function parameters
+// The architecture in use is switched to the one recorded in the header
 bool ReadParameters(std::istream& stream);
 
 // write evaluation function parameters
 bool WriteParameters(std::ostream& stream);
 
+// Check whether the file is an aligned image of the evaluation function
+bool IsImageFile(const std::string& file_name);
+
+// read an aligned image of the evaluation function
+// If map is true, the parameters are used in place from a read-only mapping
+// of the file, which is shared with other processes through the page cache.
+bool ReadImage(const std::string& file_name, bool map);
+
+// write the evaluation function parameters in use as an aligned image
+bool WriteImage(std::ostream& stream);
+
+// Whether the parameters in use are a read-only mapping of an image
+bool IsMapped();
+
+// Keep a copy of the weights of the feature transformer in use as int8 with a
+// scale per feature, which the accumulator updates read instead of the int16
+// weights. The evaluation values do not change. Only the features whose
+// weights are their scale times int8 are copied, the others are read as int16.
+// Returns the number of features copied.
+IndexType CompressFeatureWeights();
+
+// Drop the int8 copy of the weights of the feature transformer in use
+// Must be called before the weights are changed, e.g. by the learner.
+void ReleaseCompressedFeatureWeights();
+
+// Copy the parameters in use to each NUMA node for the threads bound to it
+// Returns the number of copies, 0 on a machine with a single node. The int8
+// weights of EvalCompressWeights are not copied and stay shared.
+int ReplicateParameters();
+
+// Drop the copies of the parameters in use made by ReplicateParameters()
+// Must be called before the parameters are changed, e.g. by the learner.
+void ReleaseReplicas();
+
+// read the second net of the ensemble, which may have any supported architecture
+bool ReadEnsembleParameters(std::istream& stream);
+
+// Release the second net of the ensemble
+void ReleaseEnsemble();
+
+// Whether a second net is loaded
+bool HasEnsemble();
+
+// Get a string that represents the structure of the second net
+std::string GetEnsembleArchitectureString();
+
+// Whether the second net has the architecture of the net in use
+// They then share the int8 weights of EvalCompressWeights, which are not made.
+bool EnsembleSharesArchitecture();
+
+// Evaluate the position with the second net of the ensemble
+// Its accumulator is not kept in StateInfo, but computed from the refresh cache
+// the thread keeps for the second net.
+Value ComputeEnsembleScore(const Position& pos);
+
+// Clear the refresh caches of all threads
+// Must be called whenever the parameters in use have changed.
+void ClearRefreshCaches();
+
+// Maximum number of positions propagated together by EvaluateBatch()
+constexpr std::size_t kMaxBatchSize = 32;
+
+// Calculate the evaluation values of positions with the network in use
+// The hidden layers reuse their weights for up to kMaxBatchSize positions at a
+// time. The values are the same as those of evaluate() without the eval hash.
+void EvaluateBatch(const Position* const* positions, std::size_t size,
+                   Value* scores);
+
+// Measure the forward propagation of the network in use for the position
+// Returns the average time of a call to Propagate() in nanoseconds. The sum
+// of the outputs is stored in checksum so that the calls can not be removed.
+double BenchmarkPropagate(const Position& pos, std::uint64_t iterations,
+                          std::int64_t* checksum);
+
+// Number of calls and time stamp counter cycles spent in one step of the evaluation
+struct ProfileEntry {
+  std::string name;
+  std::uint64_t calls = 0;
+  std::uint64_t cycles = 0;
+};
+
+// Steps of the evaluation timed by ProfileEvaluation()
+struct EvaluationProfile {
+  ProfileEntry refresh{"RefreshAccumulator"};
+  ProfileEntry update{"UpdateAccumulator"};
+  ProfileEntry transform{"Transform"};
+  std::vector<ProfileEntry> layers;  // from the input layer to the output layer
+  ProfileEntry eval_hash_probe{"EvalHash probe"};
+  ProfileEntry eval_hash_store{"EvalHash store"};
+  std::uint64_t eval_hash_hits = 0;
+};
+
+// Evaluate the position with the network in use and add the cycles spent in
+// each step to profile. The accumulator is refreshed if refresh is true or it
+// can not be updated from the previous position. The eval hash is probed and
+// written but the network is evaluated even if the probe hits.
+Value ProfileEvaluation(const Position& pos, bool refresh,
+                        EvaluationProfile* profile);
+
 }  // namespace NNUE
 
 }  // namespace Eval
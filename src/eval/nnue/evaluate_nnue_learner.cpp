@@ -53,6 +53,10 @@ std::vector<Example> examples;
 // Mutex for exclusive control of examples
 std::mutex examples_mutex;
 
+// examples taken from examples by LearnExamples() and not yet learned
+// (fewer than a batch). Only the thread learning them uses it.
+std::vector<Example> learn_examples;
+
 // number of samples in mini-batch
 uint64_t batch_size;
 
@@ -76,6 +80,9 @@ void SendMessages(std::vector<Message> messages) {
     trainer->SendMessage(&message);
     assert(message.num_receivers > 0);
   }
+
+  // Messages such as quantize_parameters change the parameters in use
+  ClearRefreshCaches();
 }
 
 }  // namespace
@@ -86,12 +93,32 @@ void InitializeTraining(double eta1, uint64_t eta1_epoch,
   std::cout << "Initializing NN training for "
             << GetArchitectureString() << std::endl;
 
+  // The learner is compiled for the default architecture only
+  if (GetArchitectureString() != GetArchitectureString<DefaultArchitecture>()) {
+    std::cout << "Error! The learner supports only "
+              << GetArchitectureString<DefaultArchitecture>() << std::endl;
+    my_exit();
+  }
+
+  // The parameters of a mapped image are read-only
+  if (IsMapped()) {
+    std::cout << "Error! Set EvalFileMmap to false to learn from an image" << std::endl;
+    my_exit();
+  }
+
+  // The trainer only updates the int16 weights, not their int8 and per node copies
+  ReleaseCompressedFeatureWeights();
+  ReleaseReplicas();
+
+  auto& feature_transformer = Parameters<DefaultArchitecture>::feature_transformer;
+  auto& network = Parameters<DefaultArchitecture>::network;
   assert(feature_transformer);
   assert(network);
   trainer = Trainer<Network>::Create(network.get(), feature_transformer.get());
 
   if (Options["SkipLoadingEval"]) {
     trainer->Initialize(rng);
+    ClearRefreshCaches();
   }
 
   global_learning_rate_scale = 1.0;
@@ -180,17 +207,31 @@ void AddExample(Position& pos, Color rootColor,
 
 // update the evaluation function parameters
 void UpdateParameters(uint64_t epoch) {
+  LearnExamples(epoch);
+  QuantizeParameters();
+}
+
+// Learn the examples added so far on the parameters of the trainer
+void LearnExamples(uint64_t epoch) {
   assert(batch_size > 0);
 
   EvalLearningTools::Weight::calc_eta(epoch);
   const auto learning_rate = static_cast<LearnFloatType>(
       get_eta() / batch_size);
 
-  std::lock_guard<std::mutex> lock(examples_mutex);
-  std::shuffle(examples.begin(), examples.end(), rng);
-  while (examples.size() >= batch_size) {
-    std::vector<Example> batch(examples.end() - batch_size, examples.end());
-    examples.resize(examples.size() - batch_size);
+  // AddExample() fills a new buffer while the examples are learned
+  {
+    std::lock_guard<std::mutex> lock(examples_mutex);
+    learn_examples.insert(learn_examples.end(),
+                          std::make_move_iterator(examples.begin()),
+                          std::make_move_iterator(examples.end()));
+    examples.clear();
+  }
+
+  std::shuffle(learn_examples.begin(), learn_examples.end(), rng);
+  while (learn_examples.size() >= batch_size) {
+    std::vector<Example> batch(learn_examples.end() - batch_size, learn_examples.end());
+    learn_examples.resize(learn_examples.size() - batch_size);
 
     const auto network_output = trainer->Propagate(batch);
 
@@ -205,6 +246,10 @@ void UpdateParameters(uint64_t epoch) {
 
     trainer->Backpropagate(gradients.data(), learning_rate);
   }
+}
+
+// Quantize the parameters of the trainer into those used by evaluate()
+void QuantizeParameters() {
   SendMessages({{"quantize_parameters"}});
 }
 
@@ -32,8 +32,18 @@ void AddExample(Position& pos, Color rootColor,
                 const Learner::PackedSfenValue& psv, double weight);
 
 // update the evaluation function parameters
+// Same as LearnExamples(epoch) followed by QuantizeParameters()
 void UpdateParameters(uint64_t epoch);
 
+// Learn the examples added so far on the parameters of the trainer
+// The parameters used by evaluate() do not change, so other threads may keep
+// evaluating positions and adding examples meanwhile.
+void LearnExamples(uint64_t epoch);
+
+// Quantize the parameters of the trainer into those used by evaluate()
+// No other thread may evaluate a position meanwhile.
+void QuantizeParameters();
+
 // Check if there are any problems with learning
 void CheckHealth();
 
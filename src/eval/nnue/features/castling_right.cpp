@@ -15,7 +15,7 @@ namespace Eval {
       void CastlingRight::AppendActiveIndices(
         const Position& pos, Color perspective, IndexList* active) {
         // do nothing if array size is small to avoid compiler warning
-        if (RawFeatures::kMaxActiveDimensions < kMaxActiveDimensions) return;
+        if (IndexList::kMaxSize < kMaxActiveDimensions) return;
 
         int castling_rights = pos.state()->castlingRights;
         int relative_castling_rights;
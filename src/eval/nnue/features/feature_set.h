@@ -83,7 +83,11 @@ class FeatureSetBase {
       const PositionType& pos, TriggerEvent trigger,
       IndexListType removed[2], IndexListType added[2], bool reset[2]) {
     const auto& dp = pos.state()->dirtyPiece;
-    if (dp.dirty_num == 0) return;
+    if (dp.dirty_num == 0) {
+      // null move: nothing changed, the accumulator is copied
+      reset[0] = reset[1] = false;
+      return;
+    }
 
     for (const auto perspective :Colors) {
       reset[perspective] = false;
@@ -159,6 +163,54 @@ class FeatureSetBase {
       }
     }
   }
+
+  // Add the indices changed by the dirty pieces dp of one state between the
+  // last computed accumulator and pos. Called from the newest state back to
+  // the oldest one with reset initialized to false. Once a king move requires
+  // a refresh of a perspective, the active indices of pos replace its changes.
+  // Only for feature sets whose kDirtyPieceDifferential is true.
+  template <typename IndexListType>
+  static void AppendChangedIndices(
+      const Position& pos, const DirtyPiece& dp, TriggerEvent trigger,
+      IndexListType removed[2], IndexListType added[2], bool reset[2]) {
+    // A null move does not change any feature and leaves dp.pieceNo stale
+    if (dp.dirty_num == 0) return;
+
+    for (const auto perspective :Colors) {
+      if (reset[perspective]) continue;
+      switch (trigger) {
+        case TriggerEvent::kNone:
+          break;
+        case TriggerEvent::kFriendKingMoved:
+          reset[perspective] =
+              dp.pieceNo[0] == PIECE_NUMBER_KING + perspective;
+          break;
+        case TriggerEvent::kEnemyKingMoved:
+          reset[perspective] =
+              dp.pieceNo[0] == PIECE_NUMBER_KING + ~perspective;
+          break;
+        case TriggerEvent::kAnyKingMoved:
+          reset[perspective] = dp.pieceNo[0] >= PIECE_NUMBER_KING;
+          break;
+        case TriggerEvent::kAnyPieceMoved:
+          reset[perspective] = true;
+          break;
+        default:
+          assert(false);
+          break;
+      }
+      if (reset[perspective]) {
+        removed[perspective].resize(0);
+        added[perspective].resize(0);
+        Derived::CollectActiveIndices(
+            pos, trigger, perspective, &added[perspective]);
+      } else {
+        Derived::CollectChangedIndices(
+            pos, dp, trigger, perspective,
+            &removed[perspective], &added[perspective]);
+      }
+    }
+  }
 };
 
 // Class template that represents the feature set
@@ -185,6 +237,9 @@ class FeatureSet<FirstFeatureType, RemainingFeatureTypes...> :
   using SortedTriggerSet = typename InsertToSet<TriggerEvent,
       typename Tail::SortedTriggerSet, Head::kRefreshTrigger>::Result;
   static constexpr auto kRefreshTriggers = SortedTriggerSet::kValues;
+  // Whether the changes of several plies can be collected from the dirty pieces
+  static constexpr bool kDirtyPieceDifferential =
+      IsDirtyPieceDifferential<Head>::value && Tail::kDirtyPieceDifferential;
 
   // Get the feature quantity name
   static std::string GetName() {
@@ -226,6 +281,26 @@ class FeatureSet<FirstFeatureType, RemainingFeatureTypes...> :
     }
   }
 
+  // Get a list of indices changed by the dirty pieces dp
+  template <typename IndexListType>
+  static void CollectChangedIndices(
+      const Position& pos, const DirtyPiece& dp, const TriggerEvent trigger,
+      const Color perspective,
+      IndexListType* const removed, IndexListType* const added) {
+    Tail::CollectChangedIndices(pos, dp, trigger, perspective, removed, added);
+    if (Head::kRefreshTrigger == trigger) {
+      const auto start_removed = removed->size();
+      const auto start_added = added->size();
+      Head::AppendChangedIndices(pos, dp, perspective, removed, added);
+      for (auto i = start_removed; i < removed->size(); ++i) {
+        (*removed)[i] += Tail::kDimensions;
+      }
+      for (auto i = start_added; i < added->size(); ++i) {
+        (*added)[i] += Tail::kDimensions;
+      }
+    }
+  }
+
   // Make the base class and the class template that recursively uses itself a friend
   friend class FeatureSetBase<FeatureSet>;
   template <typename... FeatureTypes>
@@ -248,6 +323,9 @@ class FeatureSet<FeatureType> : public FeatureSetBase<FeatureSet<FeatureType>> {
   using SortedTriggerSet =
       CompileTimeList<TriggerEvent, FeatureType::kRefreshTrigger>;
   static constexpr auto kRefreshTriggers = SortedTriggerSet::kValues;
+  // Whether the changes of several plies can be collected from the dirty pieces
+  static constexpr bool kDirtyPieceDifferential =
+      IsDirtyPieceDifferential<FeatureType>::value;
 
   // Get the feature quantity name
   static std::string GetName() {
@@ -273,6 +351,16 @@ class FeatureSet<FeatureType> : public FeatureSetBase<FeatureSet<FeatureType>> {
     }
   }
 
+  // Get a list of indices changed by the dirty pieces dp
+  static void CollectChangedIndices(
+      const Position& pos, const DirtyPiece& dp, const TriggerEvent trigger,
+      const Color perspective,
+      IndexList* const removed, IndexList* const added) {
+    if (FeatureType::kRefreshTrigger == trigger) {
+      FeatureType::AppendChangedIndices(pos, dp, perspective, removed, added);
+    }
+  }
+
   // Make the base class and the class template that recursively uses itself a friend
   friend class FeatureSetBase<FeatureSet>;
   template <typename... FeatureTypes>
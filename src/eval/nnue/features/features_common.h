@@ -8,6 +8,8 @@
 #include "../../../evaluate.h"
 #include "../nnue_common.h"
 
+#include <type_traits>
+
 namespace Eval {
 
 namespace NNUE {
@@ -42,6 +44,16 @@ enum class Side {
   kEnemy, // opponent
 };
 
+// Whether the changed indices of a feature only depend on the dirty pieces of
+// a state (and on king squares that cannot change without a refresh), so that
+// the changes of several plies can be collected without the positions in between
+template <typename FeatureType, typename = void>
+struct IsDirtyPieceDifferential : std::false_type {};
+template <typename FeatureType>
+struct IsDirtyPieceDifferential<FeatureType,
+    std::void_t<decltype(FeatureType::kDirtyPieceDifferential)>> :
+    std::bool_constant<FeatureType::kDirtyPieceDifferential> {};
+
 }  // namespace Features
 
 }  // namespace NNUE
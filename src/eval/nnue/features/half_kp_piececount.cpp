@@ -40,7 +40,7 @@ template <Side AssociatedKing>
 void HalfKP_PieceCount<AssociatedKing>::AppendActiveIndices(
     const Position& pos, Color perspective, IndexList* active) {
   // do nothing if array size is small to avoid compiler warning
-  if (RawFeatures::kMaxActiveDimensions < kMaxActiveDimensions) return;
+  if (IndexList::kMaxSize < kMaxActiveDimensions) return;
 
   BonaPiece* pieces;
   Square sq_target_k;
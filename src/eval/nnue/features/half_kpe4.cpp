@@ -116,13 +116,14 @@ template <Side AssociatedKing, EffectType EffectTypeUs, EffectType EffectTypeThe
 void HalfKPE4<AssociatedKing, EffectTypeUs, EffectTypeThem>::AppendActiveIndices(
     const Position& pos, Color perspective, IndexList* active) {
   // do nothing if array size is small to avoid compiler warning
-  if (RawFeatures::kMaxActiveDimensions < kMaxActiveDimensions) return;
+  if (IndexList::kMaxSize < kMaxActiveDimensions) return;
 
   BonaPiece* pieces;
   Square sq_target_k;
   GetPieces(pos, perspective, &pieces, &sq_target_k);
 
   Bitboard mobility[2][2][6];
+  pos.update_mobility();
   CalcMobility(pos.state(), mobility);
 
 #if defined(DEBUG_HALFKPE4)
@@ -182,6 +183,9 @@ void HalfKPE4<AssociatedKing, EffectTypeUs, EffectTypeThem>::AppendChangedIndice
   Bitboard mobility_now[2][2][6];
   Bitboard mobility_prev[2][2][6];
 
+  // The previous state got its mobility when its accumulator was computed
+  pos.update_mobility();
+  assert(pos.state()->previous->mobilityComputed);
   CalcMobility(pos.state(), mobility_now);
   CalcMobility(pos.state()->previous, mobility_prev);
 
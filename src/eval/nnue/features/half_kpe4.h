@@ -23,16 +23,32 @@ enum class EffectType {
   kFromSmallerPiecesOnly,
 };
 
+// HalfKPE4 nets written before the variants had distinct hash values and names
+// carry this hash value and name whatever their effect types.
+constexpr std::uint32_t kLegacyHalfKPE4HashValue = 0x5D69D3B8u;
+constexpr const char* kLegacyHalfKPE4Name = "HalfKPE4(Friend)";
+
 // Feature HalfKPE4: Combination of the position of own ball or enemy ball and the position of pieces other than balls
 template <Side AssociatedKing, EffectType EffectTypeUs, EffectType EffectTypeThem>
 class HalfKPE4 {
  public:
   // feature quantity name
+  // The letters give the effect types of us and them (A: kAll, S: kFromSmallerPiecesOnly).
   static constexpr const char* kName =
-      (AssociatedKing == Side::kFriend) ? "HalfKPE4(Friend)" : "HalfKPE4(Enemy)";
+      (AssociatedKing == Side::kFriend) ?
+      (EffectTypeUs == EffectType::kAll ?
+       (EffectTypeThem == EffectType::kAll ? "HalfKPE4AA(Friend)" : "HalfKPE4AS(Friend)") :
+       (EffectTypeThem == EffectType::kAll ? "HalfKPE4SA(Friend)" : "HalfKPE4SS(Friend)")) :
+      (EffectTypeUs == EffectType::kAll ?
+       (EffectTypeThem == EffectType::kAll ? "HalfKPE4AA(Enemy)" : "HalfKPE4AS(Enemy)") :
+       (EffectTypeThem == EffectType::kAll ? "HalfKPE4SA(Enemy)" : "HalfKPE4SS(Enemy)"));
   // Hash value embedded in the evaluation function file
+  // The effect types are mixed in so that all variants can be loaded by one
+  // binary, and bit 3 tells every variant apart from kLegacyHalfKPE4HashValue.
   static constexpr std::uint32_t kHashValue =
-      0x5D69D3B9u ^ (AssociatedKing == Side::kFriend);
+      0x5D69D3B1u ^ (AssociatedKing == Side::kFriend) ^
+      ((EffectTypeUs == EffectType::kFromSmallerPiecesOnly) << 1) ^
+      ((EffectTypeThem == EffectType::kFromSmallerPiecesOnly) << 2);
   // number of feature dimensions
   static constexpr IndexType kDimensions =
       static_cast<IndexType>(SQUARE_NB) * static_cast<IndexType>(fe_end) * 2 * 2;
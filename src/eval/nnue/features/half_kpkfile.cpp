@@ -42,7 +42,7 @@ template <Side AssociatedKing>
 void HalfKPKfile<AssociatedKing>::AppendActiveIndices(
     const Position& pos, Color perspective, IndexList* active) {
   // do nothing if array size is small to avoid compiler warning
-  if (RawFeatures::kMaxActiveDimensions < kMaxActiveDimensions) return;
+  if (IndexList::kMaxSize < kMaxActiveDimensions) return;
 
   BonaPiece* pieces;
   Square sq_target_k;
@@ -60,11 +60,19 @@ template <Side AssociatedKing>
 void HalfKPKfile<AssociatedKing>::AppendChangedIndices(
     const Position& pos, Color perspective,
     IndexList* removed, IndexList* added) {
+  AppendChangedIndices(pos, pos.state()->dirtyPiece, perspective,
+                       removed, added);
+}
+
+// Get a list of indices changed by the dirty pieces dp
+template <Side AssociatedKing>
+void HalfKPKfile<AssociatedKing>::AppendChangedIndices(
+    const Position& pos, const DirtyPiece& dp, Color perspective,
+    IndexList* removed, IndexList* added) {
   BonaPiece* pieces;
   Square sq_target_k;
   Square sq_other_k;
   GetPieces(pos, perspective, &pieces, &sq_target_k, &sq_other_k);
-  const auto& dp = pos.state()->dirtyPiece;
   for (int i = 0; i < dp.dirty_num; ++i) {
     if (dp.pieceNo[i] >= PIECE_NUMBER_KING) continue;
     const auto old_p = static_cast<BonaPiece>(
@@ -31,6 +31,8 @@ class HalfKPKfile {
   static constexpr IndexType kMaxActiveDimensions = PIECE_NUMBER_KING;
   // Timing of full calculation instead of difference calculation
   static constexpr TriggerEvent kRefreshTrigger = TriggerEvent::kAnyKingMoved;
+  // The changed indices only depend on the dirty pieces of the state
+  static constexpr bool kDirtyPieceDifferential = true;
 
   // Get a list of indices with a value of 1 among the features
   static void AppendActiveIndices(const Position& pos, Color perspective,
@@ -40,6 +42,12 @@ class HalfKPKfile {
   static void AppendChangedIndices(const Position& pos, Color perspective,
                                    IndexList* removed, IndexList* added);
 
+  // Same as above for the dirty pieces dp of pos or of one of its previous
+  // states after the last refresh, to chain the differences of several plies
+  static void AppendChangedIndices(const Position& pos, const DirtyPiece& dp,
+                                   Color perspective,
+                                   IndexList* removed, IndexList* added);
+
   // Find the index of the feature quantity from the ball position and BonaPiece
   static IndexType MakeIndex(Square sq_k, BonaPiece p, Square sq_other_k);
 
@@ -18,6 +18,8 @@ namespace Features {
 template <typename T, std::size_t MaxSize>
 class ValueList {
  public:
+  static constexpr std::size_t kMaxSize = MaxSize;
+
   std::size_t size() const { return size_; }
   void resize(std::size_t size) { size_ = size; }
   void push_back(const T& value) { values_[size_++] = value; }
@@ -40,8 +42,9 @@ class ValueList {
 };
 
 //Type of feature index list
+//Sized for the supported architecture with the most active features
 class IndexList
-    : public ValueList<IndexType, RawFeatures::kMaxActiveDimensions> {
+    : public ValueList<IndexType, SupportedArchitectures::kMaxActiveDimensions> {
 };
 
 }  // namespace Features
@@ -15,7 +15,7 @@ namespace Features {
 void K::AppendActiveIndices(
     const Position& pos, Color perspective, IndexList* active) {
   // do nothing if array size is small to avoid compiler warning
-  if (RawFeatures::kMaxActiveDimensions < kMaxActiveDimensions) return;
+  if (IndexList::kMaxSize < kMaxActiveDimensions) return;
 
   const BonaPiece* pieces = (perspective == BLACK) ?
       pos.eval_list()->piece_list_fb() :
@@ -31,7 +31,14 @@ void K::AppendActiveIndices(
 void K::AppendChangedIndices(
     const Position& pos, Color perspective,
     IndexList* removed, IndexList* added) {
-  const auto& dp = pos.state()->dirtyPiece;
+  AppendChangedIndices(pos, pos.state()->dirtyPiece, perspective,
+                       removed, added);
+}
+
+// Get a list of indices changed by the dirty pieces dp
+void K::AppendChangedIndices(
+    const Position& /*pos*/, const DirtyPiece& dp, Color perspective,
+    IndexList* removed, IndexList* added) {
   if (dp.pieceNo[0] >= PIECE_NUMBER_KING) {
     removed->push_back(
         dp.changed_piece[0].old_piece.from[perspective] - fe_end);
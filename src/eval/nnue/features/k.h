@@ -27,6 +27,8 @@ class K {
   static constexpr IndexType kMaxActiveDimensions = 2;
   // Timing of full calculation instead of difference calculation
   static constexpr TriggerEvent kRefreshTrigger = TriggerEvent::kNone;
+  // The changed indices only depend on the dirty pieces of the state
+  static constexpr bool kDirtyPieceDifferential = true;
 
   // Get a list of indices with a value of 1 among the features
   static void AppendActiveIndices(const Position& pos, Color perspective,
@@ -35,6 +37,12 @@ class K {
   // Get a list of indices whose values ​​have changed from the previous one in the feature quantity
   static void AppendChangedIndices(const Position& pos, Color perspective,
                                    IndexList* removed, IndexList* added);
+
+  // Same as above for the dirty pieces dp of pos or of one of its previous
+  // states after the last refresh, to chain the differences of several plies
+  static void AppendChangedIndices(const Position& pos, const DirtyPiece& dp,
+                                   Color perspective,
+                                   IndexList* removed, IndexList* added);
 };
 
 }  // namespace Features
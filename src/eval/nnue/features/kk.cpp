@@ -15,7 +15,7 @@ namespace Eval {
       void KK::AppendActiveIndices(
         const Position& pos, Color perspective, IndexList* active) {
         // do nothing if array size is small to avoid compiler warning
-        if (RawFeatures::kMaxActiveDimensions < kMaxActiveDimensions) return;
+        if (IndexList::kMaxSize < kMaxActiveDimensions) return;
 
         active->push_back(MakeIndex(perspective, pos.square<KING>(perspective), pos.square<KING>(~perspective)));
       }
@@ -24,6 +24,14 @@ namespace Eval {
       void KK::AppendChangedIndices(
         const Position& pos, Color perspective,
         IndexList* removed, IndexList* added) {
+        AppendChangedIndices(pos, pos.state()->dirtyPiece, perspective,
+                             removed, added);
+      }
+
+      // Get a list of indices changed by the dirty pieces dp
+      void KK::AppendChangedIndices(
+        const Position& /*pos*/, const DirtyPiece& /*dp*/, Color /*perspective*/,
+        IndexList* /*removed*/, IndexList* /*added*/) {
         // do nothing
       }
 
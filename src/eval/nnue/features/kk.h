@@ -27,6 +27,8 @@ namespace Eval {
         static constexpr IndexType kMaxActiveDimensions = 1;
         // Timing of full calculation instead of difference calculation
         static constexpr TriggerEvent kRefreshTrigger = TriggerEvent::kAnyKingMoved;
+        // The changed indices only depend on the dirty pieces of the state
+        static constexpr bool kDirtyPieceDifferential = true;
 
         // Get a list of indices with a value of 1 among the features
         static void AppendActiveIndices(const Position& pos, Color perspective,
@@ -36,6 +38,12 @@ namespace Eval {
         static void AppendChangedIndices(const Position& pos, Color perspective,
           IndexList* removed, IndexList* added);
 
+        // Same as above for the dirty pieces dp of pos or of one of its previous
+        // states after the last refresh, to chain the differences of several plies
+        static void AppendChangedIndices(const Position& pos, const DirtyPiece& dp,
+          Color perspective,
+          IndexList* removed, IndexList* added);
+
         // MakeIndex
         static IndexType MakeIndex(Color perspective, Square ksq_us, Square ksq_them);
       };
@@ -16,7 +16,7 @@ namespace Eval {
       void Mobility::AppendActiveIndices(
         const Position& pos, Color perspective, IndexList* active) {
         // do nothing if array size is small to avoid compiler warning
-        if (RawFeatures::kMaxActiveDimensions < kMaxActiveDimensions) return;
+        if (IndexList::kMaxSize < kMaxActiveDimensions) return;
 
         // mobilityCount[PieceType(Knight, Bishop, Rook, Queen)][Piece Count]
         int mobilityCount[4][2];
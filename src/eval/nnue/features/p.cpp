@@ -15,7 +15,7 @@ namespace Features {
 void P::AppendActiveIndices(
     const Position& pos, Color perspective, IndexList* active) {
   // do nothing if array size is small to avoid compiler warning
-  if (RawFeatures::kMaxActiveDimensions < kMaxActiveDimensions) return;
+  if (IndexList::kMaxSize < kMaxActiveDimensions) return;
 
   const BonaPiece* pieces = (perspective == BLACK) ?
       pos.eval_list()->piece_list_fb() :
@@ -31,7 +31,14 @@ void P::AppendActiveIndices(
 void P::AppendChangedIndices(
     const Position& pos, Color perspective,
     IndexList* removed, IndexList* added) {
-  const auto& dp = pos.state()->dirtyPiece;
+  AppendChangedIndices(pos, pos.state()->dirtyPiece, perspective,
+                       removed, added);
+}
+
+// Get a list of indices changed by the dirty pieces dp
+void P::AppendChangedIndices(
+    const Position& /*pos*/, const DirtyPiece& dp, Color perspective,
+    IndexList* removed, IndexList* added) {
   for (int i = 0; i < dp.dirty_num; ++i) {
     if (dp.pieceNo[i] >= PIECE_NUMBER_KING) continue;
     if (dp.changed_piece[i].old_piece.from[perspective] != Eval::BONA_PIECE_ZERO) {
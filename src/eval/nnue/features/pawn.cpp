@@ -5,6 +5,7 @@
 #include "pawn.h"
 #include "index_list.h"
 #include "../../../pawns.h"
+#include "../../../thread.h"
 
 namespace Eval {
 
@@ -16,7 +17,7 @@ namespace Eval {
       void Pawn::AppendActiveIndices(
         const Position& pos, Color perspective, IndexList* active) {
         // do nothing if array size is small to avoid compiler warning
-        if (RawFeatures::kMaxActiveDimensions < kMaxActiveDimensions) return;
+        if (IndexList::kMaxSize < kMaxActiveDimensions) return;
 
         // [pawn_count]
         int pawnIndex[8];
@@ -33,12 +34,16 @@ namespace Eval {
         const Position& pos, Color perspective,
         IndexList* removed, IndexList* added) {
 
+        const auto prev = pos.state()->previous;
+
+        // The indices are recomputed even if pawnKey did not change: undoing a pawn
+        // capture reorders the pawns in the piece list. The pawn structure itself
+        // is looked up in the per-thread table, so this is cheap.
+
         // [pawn_count]
         int pawnIndex[8];
         CalcPawnIndex(pawnIndex, pos, perspective);
 
-        const auto prev = pos.state()->previous;
-
         for (int pawn_count = 0; pawn_count < 8; pawn_count++) {
           if (prev->pawnIndex[perspective][pawn_count] != pawnIndex[pawn_count]) {
             removed->push_back(prev->pawnIndex[perspective][pawn_count]);
@@ -49,109 +54,112 @@ namespace Eval {
       }
 
       // CalcPawnIndex
+      // The pawns are numbered in the order of the piece list.
       void Pawn::CalcPawnIndex(int pawnIndex[8], const Position& pos, Color perspective) {
-        Color Us     = perspective;
-        Color Them   = ~Us;
-        Direction Up = pawn_push(Us);
-
-        Bitboard neighbours, stoppers, support, phalanx, opposed;
-        Bitboard lever, leverPush, blocked;
-        Square s;
-        bool backward, passed, doubled;
+        const PawnStructureEntry* e = ProbePawnStructure(pos);
+        const Bitboard ourPawns = pos.pieces(perspective, PAWN);
         const Square* pl = pos.squares<PAWN>(perspective);
-
-        Bitboard ourPawns   = pos.pieces(  Us, PAWN);
-        Bitboard theirPawns = pos.pieces(Them, PAWN);
-
-        Bitboard doubleAttackThem = pawn_double_attacks_bb(theirPawns, Them);
+        Square s;
 
         int pawn_count = 0;
-
-        // Loop through all pawns of the current color and score each pawn
         while ((s = *pl++) != SQ_NONE)
         {
-            assert(pos.piece_on(s) == make_piece(Us, PAWN));
-
-            Rank r = relative_rank(Us, s);
-
-            // Flag the pawn
-            opposed    = theirPawns & forward_file_bb(Us, s);
-            blocked    = theirPawns & (s + Up);
-            stoppers   = theirPawns & passed_pawn_span(Us, s);
-            lever      = theirPawns & pawn_attacks_bb(Us, s);
-            leverPush  = theirPawns & pawn_attacks_bb(Us, s + Up);
-            doubled    = ourPawns   & (s - Up);
-            neighbours = ourPawns   & adjacent_files_bb(s);
-            phalanx    = neighbours & rank_bb(s);
-            support    = neighbours & rank_bb(s - Up);
-
-            // A pawn is backward when it is behind all pawns of the same color on
-            // the adjacent files and cannot safely advance.
-            backward =  !(neighbours & forward_ranks_bb(Them, s + Up))
-                      && (leverPush | blocked);
-
-            // A pawn is passed if one of the three following conditions is true:
-            // (a) there is no stoppers except some levers
-            // (b) the only stoppers are the leverPush, but we outnumber them
-            // (c) there is only one front stopper which can be levered.
-            //     (Refined in Evaluation::passed)
-            passed =   !(stoppers ^ lever)
-                    || (   !(stoppers ^ leverPush)
-                        && popcount(phalanx) >= popcount(leverPush))
-                    || (   stoppers == blocked && r >= RANK_5
-                        && (shift_(support, Up) & ~(theirPawns | doubleAttackThem)));
-
-            passed &= !(forward_file_bb(Us, s) & ourPawns);
-
-            IndexType index = MakeIndex(pawn_count
-                                        , neighbours, stoppers, support, phalanx, opposed
-                                        , lever, leverPush, blocked
-                                        , backward, passed, doubled
-                                        );
-#if 0
-            std::cout << "perspective="  << perspective
-                      << ", pawn_count=" << pawn_count
-                      << ", neighbours=" << popcount(neighbours)
-                      << ", stoppers="   << popcount(stoppers)
-                      << ", support="    << popcount(support)
-                      << ", phalanx="    << popcount(phalanx)
-                      << ", opposed="    << popcount(opposed)
-                      << ", lever="      << popcount(lever)
-                      << ", leverPush="  << popcount(leverPush)
-                      << ", blocked="    << popcount(blocked)
-                      << ", backward="   << backward
-                      << ", passed="     << passed
-                      << ", doubled="    << doubled
-                      << ", index="      << index
-                      << std::endl;
-#endif
-            pawnIndex[pawn_count] = index;
+            pawnIndex[pawn_count] = MakeIndex(pawn_count, e->flags_of(perspective, ourPawns, s));
             pawn_count++;
         }
 
         while (pawn_count < 8) {
-          IndexType index = MakeIndexOfNoPiece(pawn_count);
-#if 0
-          std::cout << "perspective="  << perspective
-                    << ", pawn_count=" << pawn_count
-                    << ", index="      << index
-                    << std::endl;
-#endif
-          pawnIndex[pawn_count] = index;
+          pawnIndex[pawn_count] = MakeIndexOfNoPiece(pawn_count);
           pawn_count++;
         }
       }
 
+      // CalcPawnStructure
+      void Pawn::CalcPawnStructure(PawnStructureEntry* e, const Position& pos) {
+        for (Color Us : { WHITE, BLACK })
+        {
+            Color Them   = ~Us;
+            Direction Up = pawn_push(Us);
+
+            Bitboard neighbours, stoppers, support, phalanx, opposed;
+            Bitboard lever, leverPush, blocked;
+            bool backward, passed, doubled;
+
+            Bitboard ourPawns   = pos.pieces(  Us, PAWN);
+            Bitboard theirPawns = pos.pieces(Them, PAWN);
+
+            Bitboard doubleAttackThem = pawn_double_attacks_bb(theirPawns, Them);
+
+            int n = 0;
+
+            // Loop through all pawns of the current color in square order
+            for (Bitboard b = ourPawns; b && n < 8; ++n)
+            {
+                Square s = pop_lsb(&b);
+
+                Rank r = relative_rank(Us, s);
+
+                // Flag the pawn
+                opposed    = theirPawns & forward_file_bb(Us, s);
+                blocked    = theirPawns & (s + Up);
+                stoppers   = theirPawns & passed_pawn_span(Us, s);
+                lever      = theirPawns & pawn_attacks_bb(Us, s);
+                leverPush  = theirPawns & pawn_attacks_bb(Us, s + Up);
+                doubled    = ourPawns   & (s - Up);
+                neighbours = ourPawns   & adjacent_files_bb(s);
+                phalanx    = neighbours & rank_bb(s);
+                support    = neighbours & rank_bb(s - Up);
+
+                // A pawn is backward when it is behind all pawns of the same color on
+                // the adjacent files and cannot safely advance.
+                backward =  !(neighbours & forward_ranks_bb(Them, s + Up))
+                          && (leverPush | blocked);
+
+                // A pawn is passed if one of the three following conditions is true:
+                // (a) there is no stoppers except some levers
+                // (b) the only stoppers are the leverPush, but we outnumber them
+                // (c) there is only one front stopper which can be levered.
+                //     (Refined in Evaluation::passed)
+                passed =   !(stoppers ^ lever)
+                        || (   !(stoppers ^ leverPush)
+                            && popcount(phalanx) >= popcount(leverPush))
+                        || (   stoppers == blocked && r >= RANK_5
+                            && (shift_(support, Up) & ~(theirPawns | doubleAttackThem)));
+
+                passed &= !(forward_file_bb(Us, s) & ourPawns);
+
+                e->flags[Us][n] = MakeFlags(neighbours, stoppers, support, phalanx, opposed
+                                            , lever, leverPush, blocked
+                                            , backward, passed, doubled
+                                           );
+            }
+        }
+      }
+
+      // Get the flags of the pawn structure of pos from the table of its thread
+      const PawnStructureEntry* ProbePawnStructure(const Position& pos) {
+        const Key key = pos.pawn_key();
+        PawnStructureEntry* e = pos.this_thread()->nnuePawnStructureTable[key];
+        if (e->key != key) {
+          Pawn::CalcPawnStructure(e, pos);
+          e->key = key;
+        }
+        return e;
+      }
+
       // MakeIndex
-      inline IndexType Pawn::MakeIndex(int pawn_count
-                                       , Bitboard neighbours, Bitboard stoppers, Bitboard support, Bitboard phalanx, Bitboard opposed
-                                       , Bitboard lever, Bitboard leverPush, Bitboard blocked
-                                       , bool backward, bool passed, bool doubled
-                                      ) {
+      inline IndexType Pawn::MakeIndex(int pawn_count, int flags) {
+        return MakeIndexOfNoPiece(pawn_count) + 1 + flags;
+      }
+
+      // MakeFlags
+      int Pawn::MakeFlags(Bitboard neighbours, Bitboard stoppers, Bitboard support, Bitboard phalanx, Bitboard opposed
+                          , Bitboard lever, Bitboard leverPush, Bitboard blocked
+                          , bool backward, bool passed, bool doubled
+                         ) {
         static Bitboard ZERO_BB = Bitboard(0);
 
-        return MakeIndexOfNoPiece(pawn_count) + 1
-               + (((((((((((
+        return (((((((((
                        (ZERO_BB != neighbours)
                  * 2 + (ZERO_BB != stoppers))
                  * 2 + (ZERO_BB != support))
@@ -162,8 +170,7 @@ namespace Eval {
                  * 2 + (ZERO_BB != blocked))
                  * 2 + backward)
                  * 2 + passed)
-                 * 2 + doubled)
-               );
+                 * 2 + doubled;
       }
 
       // MakeIndexOfNoPiece
@@ -5,7 +5,9 @@
 
 #if defined(EVAL_NNUE)
 
+#include "../../../bitboard.h"
 #include "../../../evaluate.h"
+#include "../../../misc.h"
 #include "features_common.h"
 
 #define USE_PAWN_INDEX_IN_STATEINFO
@@ -16,6 +18,26 @@ namespace Eval {
 
     namespace Features {
 
+      // Structural flags of the pawns of a pawn structure.
+      // The flags of a pawn are the 11 bits (neighbours ... doubled) that Pawn::MakeIndex()
+      // adds to the index of its pawn_count. They depend only on the pawns, so each
+      // thread computes them once per pawnKey, like Pawns::Table, and the Pawn and
+      // PawnElement features look them up.
+      struct PawnStructureEntry {
+        Key key;
+        // [color][n] : flags of the n-th pawn of the color in square order
+        std::uint16_t flags[COLOR_NB][8];
+
+        // Flags of the pawn on square s, where pawns are the pawns of color c
+        int flags_of(Color c, Bitboard pawns, Square s) const {
+          return flags[c][popcount(pawns & (square_bb(s) - 1))];
+        }
+      };
+      using PawnStructureTable = HashTable<PawnStructureEntry, 16384>;
+
+      // Get the flags of the pawn structure of pos from the table of its thread
+      const PawnStructureEntry* ProbePawnStructure(const Position& pos);
+
       // Feature Pawn
       class Pawn {
       public:
@@ -42,15 +64,20 @@ namespace Eval {
           IndexList* removed, IndexList* added);
 
         // MakeIndex
-        static IndexType MakeIndex(int pawn_count
-                                   , Bitboard neighbours, Bitboard stoppers, Bitboard support, Bitboard phalanx, Bitboard opposed
-                                   , Bitboard lever, Bitboard leverPush, Bitboard blocked
-                                   , bool backward, bool passed, bool doubled
-                                  );
+        static IndexType MakeIndex(int pawn_count, int flags);
+
+        // MakeFlags
+        static int MakeFlags(Bitboard neighbours, Bitboard stoppers, Bitboard support, Bitboard phalanx, Bitboard opposed
+                             , Bitboard lever, Bitboard leverPush, Bitboard blocked
+                             , bool backward, bool passed, bool doubled
+                            );
 
         // MakeIndexOfNoPiece
         static IndexType MakeIndexOfNoPiece(int pawn_count);
 
+        // Compute the flags of all pawns of pos
+        static void CalcPawnStructure(PawnStructureEntry* e, const Position& pos);
+
       private:
         static void CalcPawnIndex(int pawnIndex[8], const Position& pos, Color perspective);
         static Bitboard pawn_double_attacks_bb(Bitboard b, Color C);
@@ -7,6 +7,7 @@
 
 #include "../../../evaluate.h"
 #include "features_common.h"
+#include "pawn.h"
 
 namespace Eval {
 
@@ -55,22 +56,11 @@ namespace Eval {
         static void AppendChangedIndices(const Position& pos, Color perspective,
           IndexList* removed, IndexList* added);
 
-        // MakeIndex
-        static IndexType MakeIndex(int pawn_count
-                                   , Bitboard neighbours, Bitboard stoppers, Bitboard support, Bitboard phalanx, Bitboard opposed
-                                   , Bitboard lever, Bitboard leverPush, Bitboard blocked
-                                   , bool backward, bool passed, bool doubled
-                                  );
-
         // MakeIndex
         static IndexType MakeIndex(int pawn_count, bool element);
 
         // MakeIndexOfNoPiece
         static IndexType MakeIndexOfNoPiece(int pawn_count);
-
-      private:
-        static Bitboard pawn_double_attacks_bb(Bitboard b, Color C);
-        static Bitboard shift_(Bitboard b, Direction D);
       };
 
     }  // namespace Features
@@ -15,7 +15,7 @@ namespace Eval {
       void PP::AppendActiveIndices(
         const Position& pos, Color perspective, IndexList* active) {
         // do nothing if array size is small to avoid compiler warning
-        if (RawFeatures::kMaxActiveDimensions < kMaxActiveDimensions) return;
+        if (IndexList::kMaxSize < kMaxActiveDimensions) return;
 
         const BonaPiece* pieces = (perspective == BLACK) ?
             pos.eval_list()->piece_list_fb() :
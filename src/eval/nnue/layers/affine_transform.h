@@ -5,6 +5,10 @@
 
 #if defined(EVAL_NNUE)
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 #include "../nnue_common.h"
 
 namespace Eval {
@@ -13,6 +17,31 @@ namespace NNUE {
 
 namespace Layers {
 
+#if defined(USE_SSSE3)
+// Positions of the set bits of every 8-bit mask and their number, used to list
+// the non-zero inputs of a layer with sparse input without branches
+struct NonZeroLookup {
+  alignas(16) std::uint16_t offsets[256][8];
+  std::uint8_t counts[256];
+};
+
+constexpr NonZeroLookup MakeNonZeroLookup() {
+  NonZeroLookup lookup = {};
+  for (int mask = 0; mask < 256; ++mask) {
+    int count = 0;
+    for (int bit = 0; bit < 8; ++bit) {
+      if (mask & (1 << bit)) {
+        lookup.offsets[mask][count++] = static_cast<std::uint16_t>(bit);
+      }
+    }
+    lookup.counts[mask] = static_cast<std::uint8_t>(count);
+  }
+  return lookup;
+}
+
+inline constexpr NonZeroLookup kNonZeroLookup = MakeNonZeroLookup();
+#endif
+
 // affine transformation layer
 template <typename PreviousLayer, IndexType OutputDimensions>
 class AffineTransform {
@@ -54,14 +83,28 @@ class AffineTransform {
         PreviousLayer::GetStructureString() + ")";
   }
 
+  // Number of layers from the input layer to this layer that compute something
+  static constexpr IndexType kNumLayers = PreviousLayer::kNumLayers + 1;
+
+  // Append the names of the layers from the input layer to this layer
+  static void AppendLayerNames(std::vector<std::string>* names) {
+    PreviousLayer::AppendLayerNames(names);
+    names->push_back("AffineTransform[" + std::to_string(kOutputDimensions) + "<-" +
+                     std::to_string(kInputDimensions) + "]");
+  }
+
   // read parameters
+  // The file holds the weights row by row, which are rearranged into the layout in memory.
   bool ReadParameters(std::istream& stream) {
     if (!previous_layer_.ReadParameters(stream)) return false;
     stream.read(reinterpret_cast<char*>(biases_),
                 kOutputDimensions * sizeof(BiasType));
-    stream.read(reinterpret_cast<char*>(weights_),
-                kOutputDimensions * kPaddedInputDimensions *
-                sizeof(WeightType));
+    WeightType row[kPaddedInputDimensions];
+    for (IndexType i = 0; i < kOutputDimensions; ++i) {
+      stream.read(reinterpret_cast<char*>(row), sizeof(row));
+      for (IndexType j = 0; j < kPaddedInputDimensions; ++j)
+        weights_[GetWeightIndex(i, j)] = row[j];
+    }
     return !stream.fail();
   }
 
@@ -70,18 +113,86 @@ class AffineTransform {
     if (!previous_layer_.WriteParameters(stream)) return false;
     stream.write(reinterpret_cast<const char*>(biases_),
                  kOutputDimensions * sizeof(BiasType));
-    stream.write(reinterpret_cast<const char*>(weights_),
-                 kOutputDimensions * kPaddedInputDimensions *
-                 sizeof(WeightType));
+    WeightType row[kPaddedInputDimensions];
+    for (IndexType i = 0; i < kOutputDimensions; ++i) {
+      for (IndexType j = 0; j < kPaddedInputDimensions; ++j)
+        row[j] = weights_[GetWeightIndex(i, j)];
+      stream.write(reinterpret_cast<const char*>(row), sizeof(row));
+    }
     return !stream.fail();
   }
 
+  // Distance between the outputs of consecutive positions in PropagateBatch()
+  static constexpr IndexType GetBatchStride(IndexType /*transformed_stride*/) {
+    return kSelfBufferSize / sizeof(OutputType);
+  }
+
   // forward propagation
   const OutputType* Propagate(
       const TransformedFeatureType* transformed_features, char* buffer) const {
     const auto input = previous_layer_.Propagate(
         transformed_features, buffer + kSelfBufferSize);
     const auto output = reinterpret_cast<OutputType*>(buffer);
+    Compute(input, output);
+    return output;
+  }
+
+  // forward propagation that adds the cycles spent in each layer to
+  // cycles[0] (the first layer after the input) ... cycles[kNumLayers - 1] (this layer)
+  const OutputType* PropagateProfiled(
+      const TransformedFeatureType* transformed_features, char* buffer,
+      std::uint64_t* cycles) const {
+    const auto input = previous_layer_.PropagateProfiled(
+        transformed_features, buffer + kSelfBufferSize, cycles);
+    const auto output = reinterpret_cast<OutputType*>(buffer);
+    const auto start = ReadTimestampCounter();
+    Compute(input, output);
+    cycles[kNumLayers - 1] += ReadTimestampCounter() - start;
+    return output;
+  }
+
+  // forward propagation of batch_size positions
+  // The transformed features of consecutive positions are transformed_stride apart.
+  const OutputType* PropagateBatch(
+      const TransformedFeatureType* transformed_features,
+      IndexType transformed_stride, IndexType batch_size, char* buffer) const {
+    const auto input = previous_layer_.PropagateBatch(
+        transformed_features, transformed_stride, batch_size,
+        buffer + kSelfBufferSize * batch_size);
+    const auto output = reinterpret_cast<OutputType*>(buffer);
+    const IndexType input_stride =
+        PreviousLayer::GetBatchStride(transformed_stride);
+    constexpr IndexType output_stride = GetBatchStride(0);
+    IndexType b = 0;
+#if defined(USE_SSSE3)
+    if constexpr (kUseColumnLayout && kBatchTileSize > 1) {
+      for (; b + kBatchTileSize <= batch_size; b += kBatchTileSize) {
+        PropagateColumnsTile(&input[b * input_stride], input_stride,
+                             &output[b * output_stride]);
+      }
+    }
+#endif
+    for (; b < batch_size; ++b) {
+      Compute(&input[b * input_stride], &output[b * output_stride]);
+    }
+    return output;
+  }
+
+ private:
+  // forward propagation of one position from the output of the previous layer
+  void Compute(const InputType* input, OutputType* output) const {
+#if defined(USE_SSSE3)
+    if constexpr (kUseSparseInput) {
+      PropagateColumnsSparse(input, output);
+      return;
+    } else if constexpr (kUseColumnLayout) {
+      PropagateColumns(input, output);
+      return;
+    }
+#endif
+#if defined(USE_VNNI) || defined(USE_AVXVNNI)
+    PropagateVnni(input, output);
+#else
 #if defined(USE_AVX512)
     constexpr IndexType kNumChunks = kPaddedInputDimensions / (kSimdWidth * 2);
     const __m512i kOnes = _mm512_set1_epi16(1);
@@ -186,10 +297,334 @@ class AffineTransform {
       output[i] = sum;
 #endif
     }
-    return output;
+#endif
   }
 
- private:
+  // Whether the weights are stored in the column layout in memory.
+  // In the column layout, the weights of 4 consecutive inputs are stored for all
+  // outputs together, so that the outputs are computed in separate SIMD lanes
+  // without horizontal sums (see PropagateColumns()). The layout is used by the
+  // SIMD builds for layers with a few registers of outputs, i.e. the hidden layers.
+#if defined(USE_SSSE3)
+  static constexpr bool kUseColumnLayout =
+      kOutputDimensions % 16 == 0 && kOutputDimensions <= 32;
+#else
+  static constexpr bool kUseColumnLayout = false;
+#endif
+
+  // Whether Compute() skips the groups of 4 inputs that are all zero.
+  // The first hidden layer reads the clipped output of the feature transformer,
+  // which is mostly zero, so only a fraction of its weight columns is needed.
+  // Listing the non-zero groups does not pay off for the small hidden layers.
+  static constexpr bool kUseSparseInput =
+      kUseColumnLayout && kPaddedInputDimensions >= 256;
+
+  // Index of the weight of the j-th input of the i-th output in weights_
+  static constexpr IndexType GetWeightIndex(IndexType i, IndexType j) {
+    return kUseColumnLayout ?
+        (j / 4) * (kOutputDimensions * 4) + i * 4 + j % 4 :
+        i * kPaddedInputDimensions + j;
+  }
+
+#if defined(USE_SSSE3)
+  // SIMD operations used by PropagateColumns()
+#if defined(USE_AVX512)
+  using VectorType = __m512i;
+  static VectorType VectorSet1(std::int32_t a) { return _mm512_set1_epi32(a); }
+  static VectorType VectorAdd(VectorType a, VectorType b) { return _mm512_add_epi32(a, b); }
+  static VectorType VectorLoad(const void* p) { return _mm512_load_si512(p); }
+  static void VectorStore(void* p, VectorType a) { _mm512_store_si512(p, a); }
+#elif defined(USE_AVX2)
+  using VectorType = __m256i;
+  static VectorType VectorSet1(std::int32_t a) { return _mm256_set1_epi32(a); }
+  static VectorType VectorAdd(VectorType a, VectorType b) { return _mm256_add_epi32(a, b); }
+  static VectorType VectorLoad(const void* p) { return _mm256_load_si256(static_cast<const VectorType*>(p)); }
+  static void VectorStore(void* p, VectorType a) { _mm256_store_si256(static_cast<VectorType*>(p), a); }
+#else
+  using VectorType = __m128i;
+  static VectorType VectorSet1(std::int32_t a) { return _mm_set1_epi32(a); }
+  static VectorType VectorAdd(VectorType a, VectorType b) { return _mm_add_epi32(a, b); }
+  static VectorType VectorLoad(const void* p) { return _mm_load_si128(static_cast<const VectorType*>(p)); }
+  static void VectorStore(void* p, VectorType a) { _mm_store_si128(static_cast<VectorType*>(p), a); }
+#endif
+
+  // sum + (u8 x s8 products of a and b, summed in groups of 4 into 32-bit lanes)
+  static VectorType VectorDot(VectorType sum, VectorType a, VectorType b) {
+#if defined(USE_VNNI)
+    return _mm512_dpbusd_epi32(sum, a, b);
+#elif defined(USE_AVX512)
+    const VectorType product = _mm512_maddubs_epi16(a, b);
+    return _mm512_add_epi32(sum, _mm512_madd_epi16(product, _mm512_set1_epi16(1)));
+#elif defined(USE_AVXVNNI)
+    return _mm256_dpbusd_avx_epi32(sum, a, b);
+#elif defined(USE_AVX2)
+    const VectorType product = _mm256_maddubs_epi16(a, b);
+    return _mm256_add_epi32(sum, _mm256_madd_epi16(product, _mm256_set1_epi16(1)));
+#else
+    const VectorType product = _mm_maddubs_epi16(a, b);
+    return _mm_add_epi32(sum, _mm_madd_epi16(product, _mm_set1_epi16(1)));
+#endif
+  }
+
+  // Number of registers holding the outputs in the column layout
+  static constexpr IndexType kOutputsPerRegister = sizeof(VectorType) / sizeof(OutputType);
+  static constexpr IndexType kNumRegisters = kOutputDimensions / kOutputsPerRegister;
+
+  // Number of independent sums of the column layout.
+  // vpdpbusd has a longer latency than the add of maddubs/madd, so the VNNI
+  // builds accumulate interleaved steps into separate sums.
+#if defined(USE_VNNI)
+  static constexpr IndexType kNumSums = 4;
+#elif defined(USE_AVXVNNI)
+  static constexpr IndexType kNumSums = 2;
+#else
+  static constexpr IndexType kNumSums = 1;
+#endif
+
+  // Number of positions propagated together by PropagateBatch(), so that their
+  // sums fit in half of the registers
+  static constexpr IndexType kBatchTileSize =
+      kNumRegisters < 8 ? 8 / std::max<IndexType>(kNumRegisters, 1) : 1;
+
+  // Forward propagation for the column layout.
+  // Each step broadcasts 4 inputs and multiplies them with their weights for all
+  // outputs at once.
+  void PropagateColumns(const InputType* input, OutputType* output) const {
+    constexpr IndexType kNumSteps = kPaddedInputDimensions / 4;
+    static_assert(kOutputDimensions % kOutputsPerRegister == 0, "");
+    static_assert(kNumSteps % kNumSums == 0, "");
+
+    VectorType sums[kNumSums][kNumRegisters];
+    for (IndexType k = 0; k < kNumRegisters; ++k) {
+      sums[0][k] = VectorLoad(&biases_[k * kOutputsPerRegister]);
+      for (IndexType n = 1; n < kNumSums; ++n)
+        sums[n][k] = VectorSet1(0);
+    }
+    for (IndexType j = 0; j < kNumSteps; j += kNumSums) {
+      for (IndexType n = 0; n < kNumSums; ++n) {
+        std::int32_t in;
+        std::memcpy(&in, &input[(j + n) * 4], sizeof(in));
+        const VectorType in_vector = VectorSet1(in);
+        const auto column = &weights_[(j + n) * (kOutputDimensions * 4)];
+        for (IndexType k = 0; k < kNumRegisters; ++k)
+          sums[n][k] = VectorDot(sums[n][k], in_vector,
+                                 VectorLoad(&column[k * sizeof(VectorType)]));
+      }
+    }
+    for (IndexType k = 0; k < kNumRegisters; ++k) {
+      for (IndexType n = 1; n < kNumSums; ++n)
+        sums[0][k] = VectorAdd(sums[0][k], sums[n][k]);
+      VectorStore(&output[k * kOutputsPerRegister], sums[0][k]);
+    }
+  }
+
+  // Bits of the groups of 4 inputs among the 32 inputs at input that are not all zero
+  // The inputs are at most 127, so a group is not zero iff it is positive as int32.
+  static unsigned NonZeroMask(const InputType* input) {
+#if defined(USE_AVX2)
+    const __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input));
+    return static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(
+        _mm256_cmpgt_epi32(in, _mm256_setzero_si256()))));
+#else
+    const __m128i in0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+    const __m128i in1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + 16));
+    const unsigned mask0 = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(
+        _mm_cmpgt_epi32(in0, _mm_setzero_si128()))));
+    const unsigned mask1 = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(
+        _mm_cmpgt_epi32(in1, _mm_setzero_si128()))));
+    return mask0 | (mask1 << 4);
+#endif
+  }
+
+  // Forward propagation for the column layout that only reads the columns of
+  // the groups of 4 inputs that are not all zero. Their steps are listed first,
+  // 8 groups at a time with a lookup of the offsets of the mask bits. The sums
+  // are the same as those of PropagateColumns().
+  void PropagateColumnsSparse(const InputType* input, OutputType* output) const {
+    constexpr IndexType kNumSteps = kPaddedInputDimensions / 4;
+    static_assert(kPaddedInputDimensions % 32 == 0, "");
+
+    std::uint16_t steps[kNumSteps];
+    IndexType num_steps = 0;
+    const __m128i kIncrement = _mm_set1_epi16(8);
+    __m128i base = _mm_setzero_si128();
+    for (IndexType j = 0; j < kPaddedInputDimensions; j += 32) {
+      const unsigned mask = NonZeroMask(&input[j]);
+      const __m128i offsets = _mm_load_si128(
+          reinterpret_cast<const __m128i*>(kNonZeroLookup.offsets[mask]));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(&steps[num_steps]),
+                       _mm_add_epi16(base, offsets));
+      num_steps += kNonZeroLookup.counts[mask];
+      base = _mm_add_epi16(base, kIncrement);
+    }
+
+    VectorType sums[kNumSums][kNumRegisters];
+    for (IndexType k = 0; k < kNumRegisters; ++k) {
+      sums[0][k] = VectorLoad(&biases_[k * kOutputsPerRegister]);
+      for (IndexType n = 1; n < kNumSums; ++n)
+        sums[n][k] = VectorSet1(0);
+    }
+    const auto accumulate = [&](VectorType* sum, IndexType step) {
+      std::int32_t in;
+      std::memcpy(&in, &input[step * 4], sizeof(in));
+      const VectorType in_vector = VectorSet1(in);
+      const auto column = &weights_[step * (kOutputDimensions * 4)];
+      for (IndexType k = 0; k < kNumRegisters; ++k)
+        sum[k] = VectorDot(sum[k], in_vector,
+                           VectorLoad(&column[k * sizeof(VectorType)]));
+    };
+    IndexType i = 0;
+    for (; i + kNumSums <= num_steps; i += kNumSums)
+      for (IndexType n = 0; n < kNumSums; ++n)
+        accumulate(sums[n], steps[i + n]);
+    for (; i < num_steps; ++i)
+      accumulate(sums[0], steps[i]);
+    for (IndexType k = 0; k < kNumRegisters; ++k) {
+      for (IndexType n = 1; n < kNumSums; ++n)
+        sums[0][k] = VectorAdd(sums[0][k], sums[n][k]);
+      VectorStore(&output[k * kOutputsPerRegister], sums[0][k]);
+    }
+  }
+
+  // Forward propagation of kBatchTileSize positions for the column layout.
+  // The weights of a step are loaded once and multiplied with the inputs of all
+  // positions of the tile, whose sums also make independent dependency chains.
+  void PropagateColumnsTile(const InputType* input, IndexType input_stride,
+                            OutputType* output) const {
+    constexpr IndexType kNumSteps = kPaddedInputDimensions / 4;
+    constexpr IndexType output_stride = GetBatchStride(0);
+
+    VectorType sums[kBatchTileSize][kNumRegisters];
+    for (IndexType b = 0; b < kBatchTileSize; ++b)
+      for (IndexType k = 0; k < kNumRegisters; ++k)
+        sums[b][k] = VectorLoad(&biases_[k * kOutputsPerRegister]);
+    for (IndexType j = 0; j < kNumSteps; ++j) {
+      const auto column = &weights_[j * (kOutputDimensions * 4)];
+      VectorType weights[kNumRegisters];
+      for (IndexType k = 0; k < kNumRegisters; ++k)
+        weights[k] = VectorLoad(&column[k * sizeof(VectorType)]);
+      for (IndexType b = 0; b < kBatchTileSize; ++b) {
+        std::int32_t in;
+        std::memcpy(&in, &input[b * input_stride + j * 4], sizeof(in));
+        const VectorType in_vector = VectorSet1(in);
+        for (IndexType k = 0; k < kNumRegisters; ++k)
+          sums[b][k] = VectorDot(sums[b][k], in_vector, weights[k]);
+      }
+    }
+    for (IndexType b = 0; b < kBatchTileSize; ++b)
+      for (IndexType k = 0; k < kNumRegisters; ++k)
+        VectorStore(&output[b * output_stride + k * kOutputsPerRegister], sums[b][k]);
+  }
+#endif
+
+#if defined(USE_VNNI) || defined(USE_AVXVNNI)
+  // Number of output rows computed together, so that their horizontal sums are
+  // reduced at once
+  static constexpr IndexType kNumRowsPerGroup = 4;
+
+  // multiply-accumulate u8 x s8 into 32-bit lanes (vpdpbusd)
+  static __m256i Dpbusd(__m256i sum, __m256i a, __m256i b) {
+#if defined(USE_VNNI)
+    return _mm256_dpbusd_epi32(sum, a, b);
+#else
+    return _mm256_dpbusd_avx_epi32(sum, a, b);
+#endif
+  }
+
+  // horizontal sums of four vectors, in order
+  static __m128i HaddX4(__m256i sum0, __m256i sum1, __m256i sum2, __m256i sum3) {
+    sum0 = _mm256_hadd_epi32(sum0, sum1);
+    sum2 = _mm256_hadd_epi32(sum2, sum3);
+    sum0 = _mm256_hadd_epi32(sum0, sum2);
+    return _mm_add_epi32(_mm256_castsi256_si128(sum0),
+                         _mm256_extracti128_si256(sum0, 1));
+  }
+
+#if defined(USE_VNNI)
+  static __m256i Fold(__m512i sum) {
+    return _mm256_add_epi32(_mm512_castsi512_si256(sum),
+                            _mm512_extracti64x4_epi64(sum, 1));
+  }
+#endif
+
+  // Forward propagation with vpdpbusd.
+  // Unlike maddubs, it does not saturate the intermediate 16-bit sums, so the
+  // result can only differ from the other paths for weights that saturate there.
+  // The input is loaded unaligned (see the HACK comment for MinGW in Propagate()).
+  void PropagateVnni(const InputType* input, OutputType* output) const {
+    IndexType i = 0;
+#if defined(USE_VNNI)
+    if constexpr (kPaddedInputDimensions % 64 == 0) {
+      constexpr IndexType kNumChunks = kPaddedInputDimensions / 64;
+      const auto input_vector = reinterpret_cast<const __m512i*>(input);
+      for (; i + kNumRowsPerGroup <= kOutputDimensions; i += kNumRowsPerGroup) {
+        const auto row0 = reinterpret_cast<const __m512i*>(&weights_[(i + 0) * kPaddedInputDimensions]);
+        const auto row1 = reinterpret_cast<const __m512i*>(&weights_[(i + 1) * kPaddedInputDimensions]);
+        const auto row2 = reinterpret_cast<const __m512i*>(&weights_[(i + 2) * kPaddedInputDimensions]);
+        const auto row3 = reinterpret_cast<const __m512i*>(&weights_[(i + 3) * kPaddedInputDimensions]);
+        __m512i sum0 = _mm512_setzero_si512();
+        __m512i sum1 = _mm512_setzero_si512();
+        __m512i sum2 = _mm512_setzero_si512();
+        __m512i sum3 = _mm512_setzero_si512();
+        for (IndexType j = 0; j < kNumChunks; ++j) {
+          const __m512i in = _mm512_loadu_si512(&input_vector[j]);
+          sum0 = _mm512_dpbusd_epi32(sum0, in, _mm512_load_si512(&row0[j]));
+          sum1 = _mm512_dpbusd_epi32(sum1, in, _mm512_load_si512(&row1[j]));
+          sum2 = _mm512_dpbusd_epi32(sum2, in, _mm512_load_si512(&row2[j]));
+          sum3 = _mm512_dpbusd_epi32(sum3, in, _mm512_load_si512(&row3[j]));
+        }
+        const __m128i bias = _mm_load_si128(reinterpret_cast<const __m128i*>(&biases_[i]));
+        _mm_store_si128(reinterpret_cast<__m128i*>(&output[i]), _mm_add_epi32(
+            HaddX4(Fold(sum0), Fold(sum1), Fold(sum2), Fold(sum3)), bias));
+      }
+      for (; i < kOutputDimensions; ++i) {
+        const auto row = reinterpret_cast<const __m512i*>(&weights_[i * kPaddedInputDimensions]);
+        __m512i sum = _mm512_setzero_si512();
+        for (IndexType j = 0; j < kNumChunks; ++j) {
+          sum = _mm512_dpbusd_epi32(sum, _mm512_loadu_si512(&input_vector[j]),
+                                    _mm512_load_si512(&row[j]));
+        }
+        output[i] = _mm512_reduce_add_epi32(sum) + biases_[i];
+      }
+      return;
+    }
+#endif
+    constexpr IndexType kNumChunks = kPaddedInputDimensions / 32;
+    const auto input_vector = reinterpret_cast<const __m256i*>(input);
+    for (; i + kNumRowsPerGroup <= kOutputDimensions; i += kNumRowsPerGroup) {
+      const auto row0 = reinterpret_cast<const __m256i*>(&weights_[(i + 0) * kPaddedInputDimensions]);
+      const auto row1 = reinterpret_cast<const __m256i*>(&weights_[(i + 1) * kPaddedInputDimensions]);
+      const auto row2 = reinterpret_cast<const __m256i*>(&weights_[(i + 2) * kPaddedInputDimensions]);
+      const auto row3 = reinterpret_cast<const __m256i*>(&weights_[(i + 3) * kPaddedInputDimensions]);
+      __m256i sum0 = _mm256_setzero_si256();
+      __m256i sum1 = _mm256_setzero_si256();
+      __m256i sum2 = _mm256_setzero_si256();
+      __m256i sum3 = _mm256_setzero_si256();
+      for (IndexType j = 0; j < kNumChunks; ++j) {
+        const __m256i in = _mm256_loadu_si256(&input_vector[j]);
+        sum0 = Dpbusd(sum0, in, _mm256_load_si256(&row0[j]));
+        sum1 = Dpbusd(sum1, in, _mm256_load_si256(&row1[j]));
+        sum2 = Dpbusd(sum2, in, _mm256_load_si256(&row2[j]));
+        sum3 = Dpbusd(sum3, in, _mm256_load_si256(&row3[j]));
+      }
+      const __m128i bias = _mm_load_si128(reinterpret_cast<const __m128i*>(&biases_[i]));
+      _mm_store_si128(reinterpret_cast<__m128i*>(&output[i]),
+                      _mm_add_epi32(HaddX4(sum0, sum1, sum2, sum3), bias));
+    }
+    for (; i < kOutputDimensions; ++i) {
+      const auto row = reinterpret_cast<const __m256i*>(&weights_[i * kPaddedInputDimensions]);
+      __m256i sum = _mm256_setzero_si256();
+      for (IndexType j = 0; j < kNumChunks; ++j) {
+        sum = Dpbusd(sum, _mm256_loadu_si256(&input_vector[j]), _mm256_load_si256(&row[j]));
+      }
+      const __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                                           _mm256_extracti128_si256(sum, 1));
+      output[i] = _mm_cvtsi128_si32(_mm_hadd_epi32(_mm_hadd_epi32(sum128, sum128), _mm_setzero_si128()))
+                + biases_[i];
+    }
+  }
+#endif
+
   // parameter type
   using BiasType = OutputType;
   using WeightType = std::int8_t;
@@ -5,6 +5,8 @@
 
 #if defined(EVAL_NNUE)
 
+#include <vector>
+
 #include "../nnue_common.h"
 
 namespace Eval {
@@ -49,6 +51,15 @@ class ClippedReLU {
         PreviousLayer::GetStructureString() + ")";
   }
 
+  // Number of layers from the input layer to this layer that compute something
+  static constexpr IndexType kNumLayers = PreviousLayer::kNumLayers + 1;
+
+  // Append the names of the layers from the input layer to this layer
+  static void AppendLayerNames(std::vector<std::string>* names) {
+    PreviousLayer::AppendLayerNames(names);
+    names->push_back("ClippedReLU[" + std::to_string(kOutputDimensions) + "]");
+  }
+
   // read parameters
   bool ReadParameters(std::istream& stream) {
     return previous_layer_.ReadParameters(stream);
@@ -59,12 +70,54 @@ class ClippedReLU {
     return previous_layer_.WriteParameters(stream);
   }
 
+  // Distance between the outputs of consecutive positions in PropagateBatch()
+  static constexpr IndexType GetBatchStride(IndexType /*transformed_stride*/) {
+    return kSelfBufferSize / sizeof(OutputType);
+  }
+
   // forward propagation
   const OutputType* Propagate(
       const TransformedFeatureType* transformed_features, char* buffer) const {
     const auto input = previous_layer_.Propagate(
         transformed_features, buffer + kSelfBufferSize);
     const auto output = reinterpret_cast<OutputType*>(buffer);
+    Compute(input, output);
+    return output;
+  }
+
+  // forward propagation that adds the cycles spent in each layer to
+  // cycles[0] (the first layer after the input) ... cycles[kNumLayers - 1] (this layer)
+  const OutputType* PropagateProfiled(
+      const TransformedFeatureType* transformed_features, char* buffer,
+      std::uint64_t* cycles) const {
+    const auto input = previous_layer_.PropagateProfiled(
+        transformed_features, buffer + kSelfBufferSize, cycles);
+    const auto output = reinterpret_cast<OutputType*>(buffer);
+    const auto start = ReadTimestampCounter();
+    Compute(input, output);
+    cycles[kNumLayers - 1] += ReadTimestampCounter() - start;
+    return output;
+  }
+
+  // forward propagation of batch_size positions
+  const OutputType* PropagateBatch(
+      const TransformedFeatureType* transformed_features,
+      IndexType transformed_stride, IndexType batch_size, char* buffer) const {
+    const auto input = previous_layer_.PropagateBatch(
+        transformed_features, transformed_stride, batch_size,
+        buffer + kSelfBufferSize * batch_size);
+    const auto output = reinterpret_cast<OutputType*>(buffer);
+    const IndexType input_stride =
+        PreviousLayer::GetBatchStride(transformed_stride);
+    for (IndexType b = 0; b < batch_size; ++b) {
+      Compute(&input[b * input_stride], &output[b * GetBatchStride(0)]);
+    }
+    return output;
+  }
+
+ private:
+  // forward propagation of one position from the output of the previous layer
+  void Compute(const InputType* input, OutputType* output) const {
 #if defined(USE_AVX2)
     constexpr IndexType kNumChunks = kInputDimensions / kSimdWidth;
     const __m256i kZero = _mm256_setzero_si256();
@@ -155,10 +208,8 @@ class ClippedReLU {
       output[i] = static_cast<OutputType>(
           std::max(0, std::min(127, input[i] >> kWeightScaleBits)));
     }
-    return output;
   }
 
- private:
   // Make the learning class a friend
   friend class Trainer<ClippedReLU>;
 
@@ -5,6 +5,8 @@
 
 #if defined(EVAL_NNUE)
 
+#include <vector>
+
 #include "../nnue_common.h"
 
 namespace Eval {
@@ -43,6 +45,10 @@ class InputSlice {
         std::to_string(Offset + kOutputDimensions) + ")]";
   }
 
+  // The input layer only points into the transformed features
+  static constexpr IndexType kNumLayers = 0;
+  static void AppendLayerNames(std::vector<std::string>* /*names*/) {}
+
   // read parameters
   bool ReadParameters(std::istream& /*stream*/) {
     return true;
@@ -60,6 +66,26 @@ class InputSlice {
     return transformed_features + Offset;
   }
 
+  // forward propagation (see AffineTransform::PropagateProfiled())
+  const OutputType* PropagateProfiled(
+      const TransformedFeatureType* transformed_features,
+      char* /*buffer*/, std::uint64_t* /*cycles*/) const {
+    return transformed_features + Offset;
+  }
+
+  // Distance between the outputs of consecutive positions in PropagateBatch()
+  static constexpr IndexType GetBatchStride(IndexType transformed_stride) {
+    return transformed_stride;
+  }
+
+  // forward propagation of batch_size positions
+  const OutputType* PropagateBatch(
+      const TransformedFeatureType* transformed_features,
+      IndexType /*transformed_stride*/, IndexType /*batch_size*/,
+      char* /*buffer*/) const {
+    return transformed_features + Offset;
+  }
+
  private:
 };
 
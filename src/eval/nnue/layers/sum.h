@@ -80,6 +80,31 @@ class Sum : public Sum<RemainingPreviousLayers...> {
     return output;
   }
 
+  // Distance between the outputs of consecutive positions in PropagateBatch()
+  static constexpr IndexType GetBatchStride(IndexType transformed_stride) {
+    return Tail::GetBatchStride(transformed_stride);
+  }
+
+  // forward propagation of batch_size positions
+  const OutputType* PropagateBatch(
+      const TransformedFeatureType* transformed_features,
+      IndexType transformed_stride, IndexType batch_size, char* buffer) const {
+    Tail::PropagateBatch(transformed_features, transformed_stride, batch_size,
+                         buffer);
+    const auto head_output = previous_layer_.PropagateBatch(
+        transformed_features, transformed_stride, batch_size,
+        buffer + kSelfBufferSize * batch_size);
+    const auto output = reinterpret_cast<OutputType*>(buffer);
+    const IndexType head_stride = Head::GetBatchStride(transformed_stride);
+    const IndexType output_stride = GetBatchStride(transformed_stride);
+    for (IndexType b = 0; b < batch_size; ++b) {
+      for (IndexType i = 0; i < kOutputDimensions; ++i) {
+        output[b * output_stride + i] += head_output[b * head_stride + i];
+      }
+    }
+    return output;
+  }
+
  protected:
   // A string that represents the list of layers to be summed
   static std::string GetSummandsString() {
@@ -139,6 +164,19 @@ class Sum<PreviousLayer> {
     return previous_layer_.Propagate(transformed_features, buffer);
   }
 
+  // Distance between the outputs of consecutive positions in PropagateBatch()
+  static constexpr IndexType GetBatchStride(IndexType transformed_stride) {
+    return PreviousLayer::GetBatchStride(transformed_stride);
+  }
+
+  // forward propagation of batch_size positions
+  const OutputType* PropagateBatch(
+      const TransformedFeatureType* transformed_features,
+      IndexType transformed_stride, IndexType batch_size, char* buffer) const {
+    return previous_layer_.PropagateBatch(
+        transformed_features, transformed_stride, batch_size, buffer);
+  }
+
  protected:
   // A string that represents the list of layers to be summed
   static std::string GetSummandsString() {
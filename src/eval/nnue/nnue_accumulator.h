@@ -13,14 +13,45 @@ namespace NNUE {
 
 // Class that holds the result of affine transformation of input features
 // Keep the evaluation value that is the final output together
+// Sized for the largest supported architecture; the active one uses the leading part
 struct alignas(32) Accumulator {
   std::int16_t
-      accumulation[2][kRefreshTriggers.size()][kTransformedFeatureDimensions];
+      accumulation[2][kMaxRefreshTriggers][kMaxTransformedFeatureDimensions];
   Value score = VALUE_ZERO;
   bool computed_accumulation = false;
   bool computed_score = false;
 };
 
+// Accumulation of one refresh trigger and perspective together with the
+// sorted indices of the active features it was computed from
+struct alignas(kCacheLineSize) RefreshCacheEntry {
+  // Refresh triggers with more active features than this bypass the cache
+  static constexpr std::uint32_t kMaxActiveDimensions = PIECE_NUMBER_KING;
+  static constexpr std::uint32_t kEmpty = ~0u;
+
+  std::int16_t accumulation[kMaxTransformedFeatureDimensions];
+  IndexType active_indices[kMaxActiveDimensions];
+  std::uint32_t num_active = kEmpty;
+};
+
+// Per-thread cache of the last accumulation computed for each square of the
+// king whose move triggers a refresh ("Finny table"). A refresh after a king
+// move then only applies the features that differ from the cached position.
+struct RefreshCache {
+  RefreshCacheEntry entries[kMaxRefreshTriggers][COLOR_NB][SQUARE_NB];
+
+  // Forget the cached accumulations, e.g. when the parameters have changed
+  void clear() {
+    for (auto& trigger_entries : entries) {
+      for (auto& color_entries : trigger_entries) {
+        for (auto& entry : color_entries) {
+          entry.num_active = RefreshCacheEntry::kEmpty;
+        }
+      }
+    }
+  }
+};
+
 }  // namespace NNUE
 
 }  // namespace Eval
@@ -5,38 +5,104 @@
 
 #if defined(EVAL_NNUE)
 
-// include a header that defines the input features and network structure
-//#include "architectures/k-p_256x2-32-32.h"
-//#include "architectures/k-p-cr_256x2-32-32.h"
-//#include "architectures/k-p-cr-ep_256x2-32-32.h"
-//#include "architectures/halfkp_256x2-32-32.h"
-//#include "architectures/halfkp-cr-ep_256x2-32-32.h"
-//#include "architectures/halfkp_384x2-32-32.h"
-//#include "architectures/halfkp-mobility_256x2-32-32.h"
+// include the headers that define the input features and network structures
+// compiled into this binary. The architecture actually used is selected at
+// load time from the hash value in the header of the evaluation function file.
+#include "architectures/k-p_256x2-32-32.h"
+#include "architectures/k-p-cr_256x2-32-32.h"
+#include "architectures/k-p-cr-ep_256x2-32-32.h"
+#include "architectures/halfkp_256x2-32-32.h"
 #include "architectures/halfkp-pawn_256x2-32-32.h"
-//#include "architectures/halfkp-mobility-pawn_256x2-32-32.h"
-//#include "architectures/halfkp-kk_256x2-32-32.h"
-//#include "architectures/halfkp_gameply40x4_256x2-32-32.h"
-//#include "architectures/halfkpkfile_256x2-32-32.h"
-//#include "architectures/halfkpkrank_256x2-32-32.h"
-//#include "architectures/halfkp-pp_256x2-32-32.h"
-//#include "architectures/halfkpe4aa_256x2-32-32.h"
-//#include "architectures/halfkpe4as_256x2-32-32.h"
-//#include "architectures/halfkpe4sa_256x2-32-32.h"
-//#include "architectures/halfkpe4ss_256x2-32-32.h"
-//#include "architectures/halfkp_piececount_256x2-32-32.h"
+#include "architectures/halfkp-pawnelement_256x2-32-32.h"
+#include "architectures/halfkp-kk_256x2-32-32.h"
+#include "architectures/halfkp_gameply40x4_256x2-32-32.h"
+#include "architectures/halfkpkfile_256x2-32-32.h"
+#include "architectures/halfkpkrank_256x2-32-32.h"
+#include "architectures/halfkp-pp_256x2-32-32.h"
+#include "architectures/halfkp-cr-ep_256x2-32-32.h"
+#include "architectures/halfkp_384x2-32-32.h"
+#include "architectures/halfkp-mobility_256x2-32-32.h"
+#include "architectures/halfkp-mobility-pawn_256x2-32-32.h"
+#include "architectures/halfkpe4aa_256x2-32-32.h"
+#include "architectures/halfkpe4as_256x2-32-32.h"
+#include "architectures/halfkpe4sa_256x2-32-32.h"
+#include "architectures/halfkpe4ss_256x2-32-32.h"
+#include "architectures/halfkp_piececount_256x2-32-32.h"
+
+#include <algorithm>
+#include <type_traits>
 
 namespace Eval {
 
 namespace NNUE {
 
-static_assert(kTransformedFeatureDimensions % kMaxSimdWidth == 0, "");
-static_assert(Network::kOutputDimensions == 1, "");
-static_assert(std::is_same<Network::OutputType, std::int32_t>::value, "");
+// Check the requirements that the evaluation code places on an architecture
+template <typename Architecture>
+constexpr bool IsValidArchitecture() {
+  return Architecture::kTransformedFeatureDimensions % kMaxSimdWidth == 0 &&
+         Architecture::Network::kOutputDimensions == 1 &&
+         std::is_same<typename Architecture::Network::OutputType,
+                      std::int32_t>::value;
+}
+
+// A class template that represents the list of architectures compiled into the binary
+template <typename... ArchitectureTypes>
+struct ArchitectureList {
+  static_assert((IsValidArchitecture<ArchitectureTypes>() && ...), "");
+
+  static constexpr std::size_t kSize = sizeof...(ArchitectureTypes);
+
+  // Upper bounds used to size the per-position data shared by all architectures
+  static constexpr IndexType kMaxTransformedFeatureDimensions =
+      std::max({ArchitectureTypes::kTransformedFeatureDimensions...});
+  static constexpr std::size_t kMaxRefreshTriggers =
+      std::max({ArchitectureTypes::RawFeatures::kRefreshTriggers.size()...});
+  static constexpr IndexType kMaxActiveDimensions =
+      std::max({ArchitectureTypes::RawFeatures::kMaxActiveDimensions...});
+};
+
+// Architectures that can be loaded by this binary.
+using SupportedArchitectures = ArchitectureList<
+    Architectures::K_P_256x2_32_32,
+    Architectures::K_P_CR_256x2_32_32,
+    Architectures::K_P_CR_EP_256x2_32_32,
+    Architectures::HalfKP_256x2_32_32,
+    Architectures::HalfKP_Pawn_256x2_32_32,
+    Architectures::HalfKP_PawnElement_256x2_32_32,
+    Architectures::HalfKP_KK_256x2_32_32,
+    Architectures::HalfKP_GamePly40x4_256x2_32_32,
+    Architectures::HalfKPKfile_256x2_32_32,
+    Architectures::HalfKPKrank_256x2_32_32,
+    Architectures::HalfKP_PP_256x2_32_32,
+    Architectures::HalfKP_CR_EP_256x2_32_32,
+    Architectures::HalfKP_384x2_32_32,
+    Architectures::HalfKP_Mobility_256x2_32_32,
+    Architectures::HalfKP_Mobility_Pawn_256x2_32_32,
+    Architectures::HalfKPE4AA_256x2_32_32,
+    Architectures::HalfKPE4AS_256x2_32_32,
+    Architectures::HalfKPE4SA_256x2_32_32,
+    Architectures::HalfKPE4SS_256x2_32_32,
+    Architectures::HalfKP_PieceCount_256x2_32_32>;
+
+// Architecture used before an evaluation function file is loaded, when
+// learning from scratch (SkipLoadingEval), and by the learner
+using DefaultArchitecture = Architectures::HalfKP_Pawn_256x2_32_32;
+
+// Input features and network structure of the default architecture
+using RawFeatures = DefaultArchitecture::RawFeatures;
+constexpr IndexType kTransformedFeatureDimensions =
+    DefaultArchitecture::kTransformedFeatureDimensions;
+using Network = DefaultArchitecture::Network;
 
 // List of timings to perform all calculations instead of difference calculation
 constexpr auto kRefreshTriggers = RawFeatures::kRefreshTriggers;
 
+// Dimensions of the data shared by all supported architectures
+constexpr IndexType kMaxTransformedFeatureDimensions =
+    SupportedArchitectures::kMaxTransformedFeatureDimensions;
+constexpr std::size_t kMaxRefreshTriggers =
+    SupportedArchitectures::kMaxRefreshTriggers;
+
 }  // namespace NNUE
 
 }  // namespace Eval
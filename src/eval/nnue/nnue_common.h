@@ -15,6 +15,14 @@
 #include <emmintrin.h>
 #endif
 
+#include <chrono>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
 namespace Eval {
 
 namespace NNUE {
@@ -22,6 +30,24 @@ namespace NNUE {
 // A constant that represents the version of the evaluation function file
 constexpr std::uint32_t kVersion = 0x7AF32F16u;
 
+// Version of the aligned image of the evaluation function file, which holds
+// the parameters in their in-memory layout so that they can be used in place
+constexpr std::uint32_t kImageVersion = 0x7AF32F17u;
+
+// Version of the in-memory layout of the parameters stored in the image
+constexpr std::uint32_t kImageLayoutVersion = 2;
+
+// Layout of the weights of the affine transform layers in memory, which depends
+// on the instruction set (0: row by row as in the file, 1: column layout)
+#if defined(USE_SSSE3)
+constexpr std::uint32_t kAffineWeightLayout = 1;
+#else
+constexpr std::uint32_t kAffineWeightLayout = 0;
+#endif
+
+// Alignment of the parameter blocks in the image (in bytes)
+constexpr std::size_t kImageAlignment = 4096;
+
 // Constant used in evaluation value calculation
 constexpr int FV_SCALE = 16;
 constexpr int kWeightScaleBits = 6;
@@ -49,6 +75,18 @@ using IndexType = std::uint32_t;
 template <typename Layer>
 class Trainer;
 
+// Read the time stamp counter of the processor (used by test nnue profile)
+// Where there is no such counter, the nanoseconds of a steady clock are returned.
+inline std::uint64_t ReadTimestampCounter() {
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))) || \
+    defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
 // find the smallest multiple of n and above
 template <typename IntType>
 constexpr IntType CeilToMultiple(IntType n, IntType base) {
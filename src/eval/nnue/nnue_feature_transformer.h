@@ -8,18 +8,67 @@
 #include "nnue_common.h"
 #include "nnue_architecture.h"
 #include "features/index_list.h"
+#include "../../thread.h"
 
-#include <cstring> // std::memset()
+#include <algorithm>
+#include <cstdlib>
+#include <cstring> // std::memset(), std::memcpy()
+#include <numeric> // std::gcd()
 
 namespace Eval {
 
 namespace NNUE {
 
 // Input feature converter
-class FeatureTransformer {
+template <typename Architecture>
+class BasicFeatureTransformer {
  private:
+  // Input features of the architecture
+  using RawFeatures = typename Architecture::RawFeatures;
+
+  // List of timings to perform all calculations instead of difference calculation
+  static constexpr auto kRefreshTriggers = RawFeatures::kRefreshTriggers;
+
   // number of output dimensions for one side
-  static constexpr IndexType kHalfDimensions = kTransformedFeatureDimensions;
+  static constexpr IndexType kHalfDimensions =
+      Architecture::kTransformedFeatureDimensions;
+
+  // parameter type
+  using BiasType = std::int16_t;
+  using WeightType = std::int16_t;
+
+  // Registers used to keep a tile of the accumulation while applying the
+  // weights of the changed features
+#if defined(USE_AVX512)
+  using VectorType = __m512i;
+  static constexpr IndexType kMaxNumRegs = 16;
+#elif defined(USE_AVX2)
+  using VectorType = __m256i;
+  static constexpr IndexType kMaxNumRegs = 16;
+#elif defined(USE_SSE2)
+  using VectorType = __m128i;
+  static constexpr IndexType kMaxNumRegs = 16;
+#elif defined(IS_ARM)
+  using VectorType = int16x8_t;
+  static constexpr IndexType kMaxNumRegs = 16;
+#endif
+
+#if defined(USE_AVX512) || defined(USE_AVX2) || defined(USE_SSE2) || defined(IS_ARM)
+  static constexpr IndexType kNumLanes = sizeof(VectorType) / sizeof(BiasType);
+  static constexpr IndexType kNumWeightChunks = kHalfDimensions / kNumLanes;
+  static_assert(kHalfDimensions % kNumLanes == 0, "");
+
+  // The largest number of registers up to kMaxNumRegs that divides the chunks
+  static constexpr IndexType GetNumRegs() {
+    IndexType num_regs = std::min(kMaxNumRegs, kNumWeightChunks);
+    while (kNumWeightChunks % num_regs != 0) {
+      --num_regs;
+    }
+    return num_regs;
+  }
+  static constexpr IndexType kNumRegs = GetNumRegs();
+  static constexpr IndexType kTileHeight = kNumRegs * kNumLanes;
+#endif
 
  public:
   // output type
@@ -63,6 +112,54 @@ class FeatureTransformer {
     return !stream.fail();
   }
 
+  // Keep a copy of the weights as int8 with a scale per feature, which the
+  // accumulator updates read instead of the int16 weights to halve their cache
+  // footprint. A feature is copied only if every weight is its scale times an
+  // int8, so the accumulations do not change; the other features get a zero
+  // scale and keep being read as int16. Returns the number of features copied
+  // as int8, and keeps no copy if there is none. The copy is shared by the
+  // threads and is not part of the parameters, which may be a read-only
+  // mapping of an image.
+  IndexType CompressWeights() const {
+    ReleaseCompressedWeights();
+    auto compressed = static_cast<CompressedWeights*>(
+        aligned_large_pages_alloc(sizeof(CompressedWeights)));
+    if (!compressed) return 0;
+    IndexType num_compressed = 0;
+    for (IndexType index = 0; index < kInputDimensions; ++index) {
+      const WeightType* column = &weights_[kHalfDimensions * index];
+      int scale = 0;
+      for (IndexType j = 0; j < kHalfDimensions; ++j) {
+        scale = std::gcd(scale, std::abs(static_cast<int>(column[j])));
+      }
+      scale = std::max(scale, 1);
+      bool fits = scale <= 32767;
+      for (IndexType j = 0; j < kHalfDimensions && fits; ++j) {
+        const int weight = column[j] / scale;
+        fits = weight >= -128 && weight <= 127;
+        compressed->weights[kHalfDimensions * index + j] =
+            static_cast<std::int8_t>(weight);
+      }
+      compressed->scales[index] = fits ? static_cast<WeightType>(scale) : 0;
+      num_compressed += fits;
+    }
+    if (num_compressed == 0) {
+      aligned_large_pages_free(compressed, sizeof(CompressedWeights));
+      return 0;
+    }
+    compressed_weights_ = compressed;
+    return num_compressed;
+  }
+
+  // Drop the int8 copy of the weights
+  // Must be called before the weights are changed or released.
+  static void ReleaseCompressedWeights() {
+    if (compressed_weights_) {
+      aligned_large_pages_free(compressed_weights_, sizeof(CompressedWeights));
+      compressed_weights_ = nullptr;
+    }
+  }
+
   // proceed with the difference calculation if possible
   bool UpdateAccumulatorIfPossible(const Position& pos) const {
     const auto now = pos.state();
@@ -70,10 +167,21 @@ class FeatureTransformer {
       return true;
     }
     const auto prev = now->previous;
+    if (prev && !prev->accumulator.computed_accumulation) {
+      MaterializeNullMoveAccumulator(prev);
+    }
     if (prev && prev->accumulator.computed_accumulation) {
       UpdateAccumulator(pos);
+      pos.this_thread()->nnueUpdates.fetch_add(1, std::memory_order_relaxed);
       return true;
     }
+    if constexpr (RawFeatures::kDirtyPieceDifferential) {
+      if (UpdateAccumulatorFromAncestor(pos)) {
+        pos.this_thread()->nnueMultiPlyUpdates.fetch_add(
+            1, std::memory_order_relaxed);
+        return true;
+      }
+    }
     return false;
   }
 
@@ -81,8 +189,15 @@ class FeatureTransformer {
   void Transform(const Position& pos, OutputType* output, bool refresh) const {
     if (refresh || !UpdateAccumulatorIfPossible(pos)) {
       RefreshAccumulator(pos);
+      pos.this_thread()->nnueRefreshes.fetch_add(1, std::memory_order_relaxed);
     }
-    const auto& accumulation = pos.state()->accumulator.accumulation;
+    Transform(pos.state()->accumulator, pos.side_to_move(), output);
+  }
+
+  // convert the accumulation of a position with side_to_move to move
+  void Transform(const Accumulator& accumulator, Color side_to_move,
+                 OutputType* output) const {
+    const auto& accumulation = accumulator.accumulation;
 #if defined(USE_AVX2)
     constexpr IndexType kNumChunks = kHalfDimensions / kSimdWidth;
     constexpr int kControl = 0b11011000;
@@ -97,7 +212,7 @@ class FeatureTransformer {
     constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
     const int8x8_t kZero = {0};
 #endif
-    const Color perspectives[2] = {pos.side_to_move(), ~pos.side_to_move()};
+    const Color perspectives[2] = {side_to_move, ~side_to_move};
     for (IndexType p = 0; p < 2; ++p) {
       const IndexType offset = kHalfDimensions * p;
 #if defined(USE_AVX2)
@@ -183,171 +298,408 @@ class FeatureTransformer {
     }
   }
 
- private:
   // Calculate cumulative value without using difference calculation
+  // Public so that test nnue profile can time it apart from Transform().
   void RefreshAccumulator(const Position& pos) const {
-    auto& accumulator = pos.state()->accumulator;
+    RefreshAccumulator(pos, pos.state()->accumulator,
+                       pos.this_thread()->nnueRefreshCache);
+  }
+
+  // Calculate the accumulator of the position into accumulator, starting from
+  // the accumulations of cache. Used for a net other than the one in use,
+  // whose accumulator is not kept in StateInfo.
+  void RefreshAccumulator(const Position& pos, Accumulator& accumulator,
+                          RefreshCache& cache) const {
     for (IndexType i = 0; i < kRefreshTriggers.size(); ++i) {
       Features::IndexList active_indices[2];
       RawFeatures::AppendActiveIndices(pos, kRefreshTriggers[i],
                                        active_indices);
       for (const auto perspective : Colors) {
-        if (i == 0) {
-          std::memcpy(accumulator.accumulation[perspective][i], biases_,
-                      kHalfDimensions * sizeof(BiasType));
+        RefreshAccumulation(pos, i, perspective, active_indices[perspective],
+                            accumulator.accumulation[perspective][i], cache);
+      }
+    }
+
+    accumulator.computed_accumulation = true;
+    accumulator.computed_score = false;
+  }
+
+ private:
+  // Square of the king whose move triggers a refresh, which selects the entry
+  // of the refresh cache, or SQ_NONE if the trigger is not tied to one king
+  static Square RefreshCacheKingSquare(const Position& pos,
+                                       Features::TriggerEvent trigger,
+                                       Color perspective) {
+    switch (trigger) {
+      case Features::TriggerEvent::kFriendKingMoved:
+      case Features::TriggerEvent::kFriendKingMovedOrPly4181121:
+      case Features::TriggerEvent::kFriendKingMovedOrPieceCount_24_16_8:
+        return pos.square<KING>(perspective);
+      case Features::TriggerEvent::kEnemyKingMoved:
+      case Features::TriggerEvent::kEnemyKingMovedOrPly4181121:
+      case Features::TriggerEvent::kEnemyKingMovedOrPieceCount_24_16_8:
+        return pos.square<KING>(~perspective);
+      default:
+        return SQ_NONE;
+    }
+  }
+
+  // Set the i-th refresh trigger part of the accumulation of a perspective
+  // to the sum of the weights of the active features. For triggers tied to a
+  // king, start from the accumulation the thread cached for the same king
+  // square and only apply the features that differ from it.
+  void RefreshAccumulation(const Position& pos, IndexType i, Color perspective,
+                           const Features::IndexList& active_indices,
+                           BiasType* accumulation, RefreshCache& cache) const {
+    const Square ksq =
+        RefreshCacheKingSquare(pos, kRefreshTriggers[i], perspective);
+    if (ksq == SQ_NONE ||
+        active_indices.size() > RefreshCacheEntry::kMaxActiveDimensions) {
+      ResetAccumulation(i, accumulation);
+      ApplyWeights(accumulation, accumulation, nullptr, 0,
+                   active_indices.begin(), active_indices.size());
+      return;
+    }
+
+    auto& entry = cache.entries[i][perspective][ksq];
+    IndexType sorted[RefreshCacheEntry::kMaxActiveDimensions];
+    const std::uint32_t num_active =
+        static_cast<std::uint32_t>(active_indices.size());
+    std::copy(active_indices.begin(), active_indices.end(), sorted);
+    std::sort(sorted, sorted + num_active);
+
+    // Collect the features that differ from the cached ones. Start over from
+    // the biases unless there are fewer of them than active features.
+    IndexType removed[RefreshCacheEntry::kMaxActiveDimensions];
+    IndexType added[RefreshCacheEntry::kMaxActiveDimensions];
+    std::uint32_t num_removed = 0, num_added = 0;
+    bool rebuild = entry.num_active == RefreshCacheEntry::kEmpty;
+    if (!rebuild) {
+      std::uint32_t a = 0, b = 0;
+      while (a < entry.num_active || b < num_active) {
+        if (b == num_active ||
+            (a < entry.num_active && entry.active_indices[a] < sorted[b])) {
+          removed[num_removed++] = entry.active_indices[a++];
+        } else if (a == entry.num_active ||
+                   sorted[b] < entry.active_indices[a]) {
+          added[num_added++] = sorted[b++];
         } else {
-          std::memset(accumulator.accumulation[perspective][i], 0,
-                      kHalfDimensions * sizeof(BiasType));
+          ++a;
+          ++b;
         }
-        for (const auto index : active_indices[perspective]) {
-          const IndexType offset = kHalfDimensions * index;
-#if defined(USE_AVX2)
-          auto accumulation = reinterpret_cast<__m256i*>(
-              &accumulator.accumulation[perspective][i][0]);
-          auto column = reinterpret_cast<const __m256i*>(&weights_[offset]);
-          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-          for (IndexType j = 0; j < kNumChunks; ++j) {
-#if defined(__MINGW32__) || defined(__MINGW64__)
-            _mm256_storeu_si256(&accumulation[j], _mm256_add_epi16(_mm256_loadu_si256(&accumulation[j]), column[j]));
-#else
-            accumulation[j] = _mm256_add_epi16(accumulation[j], column[j]);
-#endif
-          }
-#elif defined(USE_SSE2)
-          auto accumulation = reinterpret_cast<__m128i*>(
-              &accumulator.accumulation[perspective][i][0]);
-          auto column = reinterpret_cast<const __m128i*>(&weights_[offset]);
-          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-          for (IndexType j = 0; j < kNumChunks; ++j) {
-            accumulation[j] = _mm_add_epi16(accumulation[j], column[j]);
-          }
-#elif defined(IS_ARM)
-          auto accumulation = reinterpret_cast<int16x8_t*>(
-              &accumulator.accumulation[perspective][i][0]);
-          auto column = reinterpret_cast<const int16x8_t*>(&weights_[offset]);
-          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-          for (IndexType j = 0; j < kNumChunks; ++j) {
-            accumulation[j] = vaddq_s16(accumulation[j], column[j]);
-          }
+      }
+      rebuild = num_removed + num_added >= num_active;
+    }
+    if (rebuild) {
+      ResetAccumulation(i, entry.accumulation);
+      ApplyWeights(entry.accumulation, entry.accumulation, nullptr, 0,
+                   sorted, num_active);
+    } else {
+      ApplyWeights(entry.accumulation, entry.accumulation, removed, num_removed,
+                   added, num_added);
+    }
+    std::copy(sorted, sorted + num_active, entry.active_indices);
+    entry.num_active = num_active;
+    std::memcpy(accumulation, entry.accumulation,
+                kHalfDimensions * sizeof(BiasType));
+  }
+
+  // Initialize the i-th refresh trigger part of an accumulation, which only
+  // holds the biases for the first trigger
+  void ResetAccumulation(IndexType i, BiasType* accumulation) const {
+    if (i == 0) {
+      std::memcpy(accumulation, biases_, kHalfDimensions * sizeof(BiasType));
+    } else {
+      std::memset(accumulation, 0, kHalfDimensions * sizeof(BiasType));
+    }
+  }
+
+  // Set output to input minus the weights of the removed features plus the
+  // weights of the added features. Each tile of the accumulation stays in
+  // registers while all the changed weights are applied to it, so it is read
+  // and written only once. input and output may be the same.
+  void ApplyWeights(const BiasType* input, BiasType* output,
+                    const IndexType* removed, std::size_t num_removed,
+                    const IndexType* added, std::size_t num_added) const {
+    if (compressed_weights_) {
+      ApplyWeights<true>(input, output, removed, num_removed, added, num_added);
+    } else {
+      ApplyWeights<false>(input, output, removed, num_removed, added, num_added);
+    }
+  }
+
+  // ApplyWeights() reading the int16 weights or their int8 copy
+  template <bool kCompressed>
+  void ApplyWeights(const BiasType* input, BiasType* output,
+                    const IndexType* removed, std::size_t num_removed,
+                    const IndexType* added, std::size_t num_added) const {
+#if defined(USE_AVX512) || defined(USE_AVX2) || defined(USE_SSE2) || defined(IS_ARM)
+    for (IndexType tile = 0; tile < kHalfDimensions / kTileHeight; ++tile) {
+      const IndexType offset = tile * kTileHeight;
+      VectorType regs[kNumRegs];
+      for (IndexType k = 0; k < kNumRegs; ++k) {
+        regs[k] = VectorLoad(&input[offset + k * kNumLanes]);
+      }
+      for (std::size_t r = 0; r < num_removed; ++r) {
+        for (IndexType k = 0; k < kNumRegs; ++k) {
+          regs[k] = VectorSub(regs[k], LoadWeights<kCompressed>(
+              removed[r], offset + k * kNumLanes));
+        }
+      }
+      for (std::size_t a = 0; a < num_added; ++a) {
+        for (IndexType k = 0; k < kNumRegs; ++k) {
+          regs[k] = VectorAdd(regs[k], LoadWeights<kCompressed>(
+              added[a], offset + k * kNumLanes));
+        }
+      }
+      for (IndexType k = 0; k < kNumRegs; ++k) {
+        VectorStore(&output[offset + k * kNumLanes], regs[k]);
+      }
+    }
 #else
-          for (IndexType j = 0; j < kHalfDimensions; ++j) {
-            accumulator.accumulation[perspective][i][j] += weights_[offset + j];
-          }
+    if (output != input) {
+      std::memcpy(output, input, kHalfDimensions * sizeof(BiasType));
+    }
+    for (std::size_t r = 0; r < num_removed; ++r) {
+      for (IndexType j = 0; j < kHalfDimensions; ++j) {
+        output[j] -= GetWeight<kCompressed>(removed[r], j);
+      }
+    }
+    for (std::size_t a = 0; a < num_added; ++a) {
+      for (IndexType j = 0; j < kHalfDimensions; ++j) {
+        output[j] += GetWeight<kCompressed>(added[a], j);
+      }
+    }
 #endif
-        }
+  }
+
+  // The j-th weight of a feature
+  template <bool kCompressed>
+  WeightType GetWeight(IndexType index, IndexType j) const {
+    if constexpr (kCompressed) {
+      const WeightType scale = compressed_weights_->scales[index];
+      if (scale != 0) {
+        return static_cast<WeightType>(
+            compressed_weights_->weights[kHalfDimensions * index + j] * scale);
       }
     }
+    return weights_[kHalfDimensions * index + j];
+  }
 
-    accumulator.computed_accumulation = true;
-    accumulator.computed_score = false;
+#if defined(USE_AVX512) || defined(USE_AVX2) || defined(USE_SSE2) || defined(IS_ARM)
+  // The weights j, j + 1, ... of a feature in a register. The int8 copy is
+  // widened and multiplied by the scale of the feature, unless the feature
+  // did not fit in int8 (zero scale).
+  template <bool kCompressed>
+  VectorType LoadWeights(IndexType index, IndexType j) const {
+    if constexpr (kCompressed) {
+      const WeightType scale = compressed_weights_->scales[index];
+      if (scale != 0) {
+        return VectorLoadScaled(
+            &compressed_weights_->weights[kHalfDimensions * index + j], scale);
+      }
+    }
+    return VectorLoad(&weights_[kHalfDimensions * index + j]);
+  }
+#endif
+
+#if defined(USE_AVX512)
+  static VectorType VectorLoad(const std::int16_t* p) {
+    return _mm512_loadu_si512(p);
+  }
+  static void VectorStore(std::int16_t* p, VectorType v) {
+    _mm512_storeu_si512(p, v);
+  }
+  static VectorType VectorAdd(VectorType a, VectorType b) {
+    return _mm512_add_epi16(a, b);
+  }
+  static VectorType VectorSub(VectorType a, VectorType b) {
+    return _mm512_sub_epi16(a, b);
+  }
+  static VectorType VectorLoadScaled(const std::int8_t* p, std::int16_t scale) {
+    return _mm512_mullo_epi16(_mm512_cvtepi8_epi16(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))),
+        _mm512_set1_epi16(scale));
+  }
+#elif defined(USE_AVX2)
+  static VectorType VectorLoad(const std::int16_t* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  }
+  static void VectorStore(std::int16_t* p, VectorType v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+  }
+  static VectorType VectorAdd(VectorType a, VectorType b) {
+    return _mm256_add_epi16(a, b);
+  }
+  static VectorType VectorSub(VectorType a, VectorType b) {
+    return _mm256_sub_epi16(a, b);
+  }
+  static VectorType VectorLoadScaled(const std::int8_t* p, std::int16_t scale) {
+    return _mm256_mullo_epi16(_mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))),
+        _mm256_set1_epi16(scale));
   }
+#elif defined(USE_SSE2)
+  static VectorType VectorLoad(const std::int16_t* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  }
+  static void VectorStore(std::int16_t* p, VectorType v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+  }
+  static VectorType VectorAdd(VectorType a, VectorType b) {
+    return _mm_add_epi16(a, b);
+  }
+  static VectorType VectorSub(VectorType a, VectorType b) {
+    return _mm_sub_epi16(a, b);
+  }
+  static VectorType VectorLoadScaled(const std::int8_t* p, std::int16_t scale) {
+    const __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+#if defined(USE_SSE41)
+    const __m128i widened = _mm_cvtepi8_epi16(packed);
+#else
+    const __m128i widened = _mm_srai_epi16(_mm_unpacklo_epi8(packed, packed), 8);
+#endif
+    return _mm_mullo_epi16(widened, _mm_set1_epi16(scale));
+  }
+#elif defined(IS_ARM)
+  static VectorType VectorLoad(const std::int16_t* p) {
+    return vld1q_s16(p);
+  }
+  static void VectorStore(std::int16_t* p, VectorType v) {
+    vst1q_s16(p, v);
+  }
+  static VectorType VectorAdd(VectorType a, VectorType b) {
+    return vaddq_s16(a, b);
+  }
+  static VectorType VectorSub(VectorType a, VectorType b) {
+    return vsubq_s16(a, b);
+  }
+  static VectorType VectorLoadScaled(const std::int8_t* p, std::int16_t scale) {
+    return vmulq_s16(vmovl_s8(vld1_s8(p)), vdupq_n_s16(scale));
+  }
+#endif
 
   // Calculate cumulative value using difference calculation
   void UpdateAccumulator(const Position& pos) const {
-    const auto prev_accumulator = pos.state()->previous->accumulator;
+    const auto& prev_accumulator = pos.state()->previous->accumulator;
     auto& accumulator = pos.state()->accumulator;
     for (IndexType i = 0; i < kRefreshTriggers.size(); ++i) {
       Features::IndexList removed_indices[2], added_indices[2];
       bool reset[2];
       RawFeatures::AppendChangedIndices(pos, kRefreshTriggers[i],
                                         removed_indices, added_indices, reset);
+      ApplyChangedIndices(pos, prev_accumulator, accumulator, i,
+                          removed_indices, added_indices, reset);
+    }
+
+    accumulator.computed_accumulation = true;
+    accumulator.computed_score = false;
+  }
+
+  // do_null_move() leaves the accumulator of the new state uncomputed.
+  // Copy it from the previous state once a child of the null move needs it.
+  void MaterializeNullMoveAccumulator(StateInfo* st) const {
+    if (st->dirtyPiece.dirty_num != 0 || !st->previous ||
+        !st->previous->accumulator.computed_accumulation) {
+      return;
+    }
+    const auto& prev_accumulator = st->previous->accumulator;
+    for (IndexType i = 0; i < kRefreshTriggers.size(); ++i) {
       for (const auto perspective : Colors) {
-#if defined(USE_AVX2)
-        constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-        auto accumulation = reinterpret_cast<__m256i*>(
-            &accumulator.accumulation[perspective][i][0]);
-#elif defined(USE_SSE2)
-        constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-        auto accumulation = reinterpret_cast<__m128i*>(
-            &accumulator.accumulation[perspective][i][0]);
-#elif defined(IS_ARM)
-        constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-        auto accumulation = reinterpret_cast<int16x8_t*>(
-            &accumulator.accumulation[perspective][i][0]);
-#endif
-        if (reset[perspective]) {
-          if (i == 0) {
-            std::memcpy(accumulator.accumulation[perspective][i], biases_,
-                        kHalfDimensions * sizeof(BiasType));
-          } else {
-            std::memset(accumulator.accumulation[perspective][i], 0,
-                        kHalfDimensions * sizeof(BiasType));
-          }
-        } else {// Difference calculation for the feature amount changed from 1 to 0
-          std::memcpy(accumulator.accumulation[perspective][i],
-                      prev_accumulator.accumulation[perspective][i],
-                      kHalfDimensions * sizeof(BiasType));
-          for (const auto index : removed_indices[perspective]) {
-            const IndexType offset = kHalfDimensions * index;
-#if defined(USE_AVX2)
-            auto column = reinterpret_cast<const __m256i*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm256_sub_epi16(accumulation[j], column[j]);
-            }
-#elif defined(USE_SSE2)
-            auto column = reinterpret_cast<const __m128i*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm_sub_epi16(accumulation[j], column[j]);
-            }
-#elif defined(IS_ARM)
-            auto column = reinterpret_cast<const int16x8_t*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = vsubq_s16(accumulation[j], column[j]);
-            }
-#else
-            for (IndexType j = 0; j < kHalfDimensions; ++j) {
-              accumulator.accumulation[perspective][i][j] -=
-                  weights_[offset + j];
-            }
-#endif
-          }
-        }
-        {// Difference calculation for features that changed from 0 to 1
-          for (const auto index : added_indices[perspective]) {
-            const IndexType offset = kHalfDimensions * index;
-#if defined(USE_AVX2)
-            auto column = reinterpret_cast<const __m256i*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm256_add_epi16(accumulation[j], column[j]);
-            }
-#elif defined(USE_SSE2)
-            auto column = reinterpret_cast<const __m128i*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm_add_epi16(accumulation[j], column[j]);
-            }
-#elif defined(IS_ARM)
-            auto column = reinterpret_cast<const int16x8_t*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = vaddq_s16(accumulation[j], column[j]);
-            }
-#else
-            for (IndexType j = 0; j < kHalfDimensions; ++j) {
-              accumulator.accumulation[perspective][i][j] +=
-                  weights_[offset + j];
-            }
-#endif
-          }
-        }
+        std::memcpy(st->accumulator.accumulation[perspective][i],
+                    prev_accumulator.accumulation[perspective][i],
+                    kHalfDimensions * sizeof(BiasType));
       }
     }
+    st->accumulator.computed_accumulation = true;
+    st->accumulator.computed_score = false;
+  }
+
+  // Walk back to the nearest computed accumulator and apply the changes of all
+  // plies in between at once. Null moves are crossed for free. Gives up when
+  // the changes would cost more than a refresh, which adds one column per piece.
+  bool UpdateAccumulatorFromAncestor(const Position& pos) const {
+    const int refresh_cost = pos.count<ALL_PIECES>();
+    int update_cost = 0;
+    const StateInfo* oldest = pos.state();
+    for (;;) {
+      if (!oldest->previous) {
+        return false;
+      }
+      update_cost += 2 * oldest->dirtyPiece.dirty_num;
+      if (update_cost >= refresh_cost) {
+        return false;
+      }
+      if (oldest->previous->accumulator.computed_accumulation) {
+        break;
+      }
+      oldest = oldest->previous;
+    }
+
+    const auto& prev_accumulator = oldest->previous->accumulator;
+    auto& accumulator = pos.state()->accumulator;
+    for (IndexType i = 0; i < kRefreshTriggers.size(); ++i) {
+      Features::IndexList removed_indices[2], added_indices[2];
+      bool reset[2] = {false, false};
+      for (const StateInfo* st = pos.state(); st != oldest->previous;
+           st = st->previous) {
+        RawFeatures::AppendChangedIndices(pos, st->dirtyPiece,
+                                          kRefreshTriggers[i], removed_indices,
+                                          added_indices, reset);
+      }
+      ApplyChangedIndices(pos, prev_accumulator, accumulator, i,
+                          removed_indices, added_indices, reset);
+    }
 
     accumulator.computed_accumulation = true;
     accumulator.computed_score = false;
+    return true;
   }
 
-  // parameter type
-  using BiasType = std::int16_t;
-  using WeightType = std::int16_t;
+  // Derive the i-th refresh trigger part of accumulator from prev_accumulator
+  void ApplyChangedIndices(const Position& pos,
+                           const Accumulator& prev_accumulator,
+                           Accumulator& accumulator, IndexType i,
+                           const Features::IndexList removed_indices[2],
+                           const Features::IndexList added_indices[2],
+                           const bool reset[2]) const {
+    for (const auto perspective : Colors) {
+      if (reset[perspective]) {
+        // added_indices holds all active features after a reset
+        RefreshAccumulation(pos, i, perspective, added_indices[perspective],
+                            accumulator.accumulation[perspective][i],
+                            pos.this_thread()->nnueRefreshCache);
+      } else {
+        ApplyWeights(prev_accumulator.accumulation[perspective][i],
+                     accumulator.accumulation[perspective][i],
+                     removed_indices[perspective].begin(),
+                     removed_indices[perspective].size(),
+                     added_indices[perspective].begin(),
+                     added_indices[perspective].size());
+      }
+    }
+  }
 
   // Make the learning class a friend
-  friend class Trainer<FeatureTransformer>;
+  friend class Trainer<BasicFeatureTransformer>;
 
   // parameter
   alignas(kCacheLineSize) BiasType biases_[kHalfDimensions];
   alignas(kCacheLineSize)
       WeightType weights_[kHalfDimensions * kInputDimensions];
+
+  // int8 copy of weights_, weight = weights[kHalfDimensions * index + j] * scales[index]
+  // A zero scale means the feature did not fit and weights_ is read instead.
+  struct CompressedWeights {
+    alignas(kCacheLineSize) std::int8_t weights[kHalfDimensions * kInputDimensions];
+    alignas(kCacheLineSize) WeightType scales[kInputDimensions];
+  };
+  static inline CompressedWeights* compressed_weights_ = nullptr;
 };
 
+// Input feature converter of the default architecture
+using FeatureTransformer = BasicFeatureTransformer<DefaultArchitecture>;
+
 }  // namespace NNUE
 
 }  // namespace Eval
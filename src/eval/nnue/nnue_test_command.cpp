@@ -2,6 +2,7 @@
 
 #if defined(ENABLE_TEST_CMD) && defined(EVAL_NNUE)
 
+#include "../../movegen.h"
 #include "../../thread.h"
 #include "../../uci.h"
 #include "evaluate_nnue.h"
@@ -9,6 +10,8 @@
 
 #include <set>
 #include <fstream>
+#include <iomanip>
+#include <vector>
 
 #define ASSERT(X) { if (!(X)) { std::cout << "\nError : ASSERT(" << #X << "), " << __FILE__ << "(" << __LINE__ << "): " << __func__ << std::endl; \
  std::this_thread::sleep_for(std::chrono::microseconds(3000)); *(int*)1 =0;} }
@@ -161,12 +164,19 @@ void PrintInfo(std::istream& stream) {
 
     std::cout << file_name << ": ";
     if (success) {
-      if (hash_value == kHashValue) {
-        std::cout << "matches with this binary";
-        if (architecture != GetArchitectureString()) {
+      std::string supported_architecture;
+      if (FindArchitecture(hash_value, architecture, &supported_architecture)) {
+        std::cout << "supported by this binary";
+        if (supported_architecture == GetArchitectureString()) {
+          std::cout << " (in use)";
+        }
+        if (architecture != supported_architecture) {
           std::cout << ", but architecture string differs: " << architecture;
         }
         std::cout << std::endl;
+      } else if (IsLegacyHalfKPE4(hash_value, architecture)) {
+        std::cout << "HalfKPE4 net of unknown variant, rewrite it with"
+                  << " test nnue rewrite_halfkpe4" << std::endl;
       } else {
         std::cout << architecture << std::endl;
       }
@@ -176,6 +186,185 @@ void PrintInfo(std::istream& stream) {
   }
 }
 
+// Rewrite a HalfKPE4 net written before the variants had distinct hash values
+// as a net of the given variant
+void RewriteHalfKPE4(std::istream& stream) {
+  std::string input_file_name, output_file_name, variant;
+  stream >> input_file_name >> output_file_name >> variant;
+
+  if (IsImageFile(input_file_name) || !IsLegacyHalfKPE4File(input_file_name)) {
+    std::cout << "Error! " << input_file_name << " is not a HalfKPE4 net (.bin) written"
+              << " before the variants had distinct hash values" << std::endl;
+    return;
+  }
+  if (variant != "AA" && variant != "AS" && variant != "SA" && variant != "SS") {
+    std::cout << "Error! the variant must be one of AA, AS, SA, SS" << std::endl;
+    return;
+  }
+
+  std::ifstream input(input_file_name, std::ios::binary);
+  std::ofstream output(output_file_name, std::ios::binary);
+  if (RewriteLegacyHalfKPE4(input, output, variant)) {
+    std::cout << "wrote " << output_file_name << " as HalfKPE4" << variant << std::endl;
+  } else {
+    std::cout << "Error! failed to write " << output_file_name << std::endl;
+  }
+}
+
+// Measure the time of the forward propagation of the network
+void MeasurePropagate(Position& pos, std::istream& stream) {
+  std::uint64_t iterations = 1000000;
+  stream >> iterations;
+
+  std::cout << "network architecture: " << GetArchitectureString() << std::endl;
+  // warm up the caches before measuring
+  std::int64_t checksum;
+  BenchmarkPropagate(pos, std::min<std::uint64_t>(iterations, 10000), &checksum);
+  const double ns = BenchmarkPropagate(pos, iterations, &checksum);
+  std::cout << "Propagate: " << iterations << " calls, "
+            << ns << " ns/call (checksum " << checksum << ")" << std::endl;
+}
+
+// Read a file with one FEN per line, skipping empty lines
+bool ReadFenFile(const std::string& file_name, std::vector<std::string>* fens) {
+  std::ifstream file_stream(file_name);
+  if (!file_stream) {
+    std::cout << "Error! : can't open " << file_name << std::endl;
+    return false;
+  }
+  for (std::string line; std::getline(file_stream, line); ) {
+    if (line.find_first_not_of(" \t\r") != std::string::npos) {
+      fens->push_back(line);
+    }
+  }
+  return true;
+}
+
+// Score the positions of a file with one FEN per line using EvaluateBatch()
+// The scores are from the side to move. The batched propagation is timed
+// against propagating the positions one at a time, which must give the same scores.
+void EvaluateFenFile(std::istream& stream) {
+  std::string file_name;
+  std::size_t batch_size = kMaxBatchSize;
+  stream >> file_name >> batch_size;
+  batch_size = std::max<std::size_t>(batch_size, 1);
+
+  std::vector<std::string> fens;
+  if (!ReadFenFile(file_name, &fens)) return;
+
+  std::vector<Position> positions(fens.size());
+  std::vector<StateInfo, AlignedAllocator<StateInfo>> states(fens.size());
+  std::vector<const Position*> position_pointers;
+  for (std::size_t i = 0; i < fens.size(); ++i) {
+    positions[i].set(fens[i], Options["UCI_Chess960"], &states[i], Threads.main());
+    position_pointers.push_back(&positions[i]);
+  }
+
+  // The first pass computes the accumulators, so that the timed passes below
+  // measure the network.
+  std::vector<Value> scores(fens.size()), single_scores(fens.size());
+  const auto evaluate_all = [&](std::size_t size, std::vector<Value>* values) {
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < fens.size(); i += size) {
+      EvaluateBatch(&position_pointers[i], std::min(size, fens.size() - i),
+                    &(*values)[i]);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count()
+         / std::max<std::size_t>(fens.size(), 1);
+  };
+  evaluate_all(batch_size, &scores);
+  const double single_ns = evaluate_all(1, &single_scores);
+  const double batch_ns = evaluate_all(batch_size, &scores);
+
+  std::size_t num_mismatches = 0;
+  for (std::size_t i = 0; i < fens.size(); ++i) {
+    std::cout << fens[i] << " : " << scores[i] << std::endl;
+    num_mismatches += scores[i] != single_scores[i];
+  }
+  std::cout << "network architecture: " << GetArchitectureString() << std::endl;
+  std::cout << fens.size() << " positions, batch size " << batch_size << ", "
+            << batch_ns << " ns/position (" << single_ns
+            << " ns/position one at a time), "
+            << num_mismatches << " mismatches" << std::endl;
+}
+
+// Profile the evaluation of the positions of a file with one FEN per line
+// The accumulator of each position is refreshed, and the positions after each
+// of its legal moves are updated from it. For every step of the evaluation, the
+// number of calls, the average time stamp counter cycles and nanoseconds per
+// call, and its share of the cycles of all steps are reported.
+void ProfileFenFile(std::istream& stream) {
+  std::string file_name;
+  stream >> file_name;
+
+  std::vector<std::string> fens;
+  if (!ReadFenFile(file_name, &fens)) return;
+
+  EvaluationProfile profile;
+  Position pos;
+  StateInfo root_state, state;
+  const auto start_time = std::chrono::steady_clock::now();
+  const auto start_cycles = ReadTimestampCounter();
+  for (const auto& fen : fens) {
+    pos.set(fen, Options["UCI_Chess960"], &root_state, Threads.main());
+    ProfileEvaluation(pos, true, &profile);
+    for (const auto& m : MoveList<LEGAL>(pos)) {
+      pos.do_move(m, state);
+      ProfileEvaluation(pos, false, &profile);
+      pos.undo_move(m);
+    }
+  }
+  const double elapsed_cycles = static_cast<double>(ReadTimestampCounter() - start_cycles);
+  const double elapsed_ns = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start_time).count();
+  const double ns_per_cycle = elapsed_ns / std::max(elapsed_cycles, 1.0);
+
+  std::vector<const ProfileEntry*> entries = {
+      &profile.refresh, &profile.update, &profile.transform};
+  for (const auto& layer : profile.layers) {
+    entries.push_back(&layer);
+  }
+  entries.push_back(&profile.eval_hash_probe);
+  entries.push_back(&profile.eval_hash_store);
+  std::uint64_t total_cycles = 0;
+  for (const auto entry : entries) {
+    total_cycles += entry->cycles;
+  }
+
+  std::cout << "network architecture: " << GetArchitectureString() << std::endl;
+  std::cout << std::left << std::setw(28) << "step" << std::right
+            << std::setw(12) << "calls" << std::setw(14) << "cycles/call"
+            << std::setw(12) << "ns/call" << std::setw(9) << "share" << std::endl;
+  std::cout << std::fixed << std::setprecision(1);
+  for (const auto entry : entries) {
+    if (entry->calls == 0) continue;
+    const double cycles_per_call = 1.0 * entry->cycles / entry->calls;
+    std::cout << std::left << std::setw(28) << entry->name << std::right
+              << std::setw(12) << entry->calls
+              << std::setw(14) << cycles_per_call
+              << std::setw(12) << cycles_per_call * ns_per_cycle
+              << std::setw(8) << 100.0 * entry->cycles / std::max<std::uint64_t>(total_cycles, 1)
+              << "%" << std::endl;
+  }
+  const std::uint64_t num_evaluations = profile.refresh.calls + profile.update.calls;
+  std::cout << num_evaluations << " positions, "
+            << profile.refresh.calls << " refreshes ("
+            << 100.0 * profile.refresh.calls / std::max<std::uint64_t>(num_evaluations, 1)
+            << "%), " << profile.update.calls << " incremental updates ("
+            << 100.0 * profile.update.calls / std::max<std::uint64_t>(num_evaluations, 1)
+            << "%), " << std::setprecision(3) << 1.0 / ns_per_cycle
+            << " cycles/ns" << std::endl;
+  if (profile.eval_hash_probe.calls != 0) {
+    std::cout << profile.eval_hash_hits << " eval hash hits ("
+              << std::setprecision(1)
+              << 100.0 * profile.eval_hash_hits / profile.eval_hash_probe.calls
+              << "%), the network is evaluated regardless" << std::endl;
+  }
+  std::cout.unsetf(std::ios::floatfield);
+  std::cout << std::setprecision(6);
+}
+
 }  // namespace
 
 // USI extended command for NNUE evaluation function
@@ -187,10 +376,22 @@ void TestCommand(Position& pos, std::istream& stream) {
     TestFeatures(pos);
   } else if (sub_command == "info") {
     PrintInfo(stream);
+  } else if (sub_command == "rewrite_halfkpe4") {
+    RewriteHalfKPE4(stream);
+  } else if (sub_command == "bench_propagate") {
+    MeasurePropagate(pos, stream);
+  } else if (sub_command == "eval_fens") {
+    EvaluateFenFile(stream);
+  } else if (sub_command == "profile") {
+    ProfileFenFile(stream);
   } else {
     std::cout << "usage:" << std::endl;
     std::cout << " test nnue test_features" << std::endl;
     std::cout << " test nnue info [path/to/" << fileName << "...]" << std::endl;
+    std::cout << " test nnue rewrite_halfkpe4 path/to/input.bin path/to/output.bin AA|AS|SA|SS" << std::endl;
+    std::cout << " test nnue bench_propagate [iterations]" << std::endl;
+    std::cout << " test nnue eval_fens path/to/fens.txt [batch_size]" << std::endl;
+    std::cout << " test nnue profile path/to/fens.txt" << std::endl;
   }
 }
 
@@ -12,6 +12,7 @@
 
 #include <array>
 #include <bitset>
+#include <chrono>
 #include <numeric>
 #include <random>
 #include <set>
@@ -78,11 +79,13 @@ class Trainer<FeatureTransformer> {
     for (IndexType i = 0; i < kHalfDimensions; ++i) {
       biases_[i] = static_cast<LearnFloatType>(0.5);
     }
+    dirty_features_.set();
     QuantizeParameters();
   }
 
   // forward propagation
   const LearnFloatType* Propagate(const std::vector<Example>& batch) {
+    const auto start = Clock::now();
     if (output_.size() < kOutputDimensions * batch.size()) {
       output_.resize(kOutputDimensions * batch.size());
       gradients_.resize(kOutputDimensions * batch.size());
@@ -128,12 +131,14 @@ class Trainer<FeatureTransformer> {
         max_activations_[t] = std::max(max_activations_[t], output_[index]);
       }
     }
+    propagate_time_ += Clock::now() - start;
     return output_.data();
   }
 
   // backpropagation
   void Backpropagate(const LearnFloatType* gradients,
                      LearnFloatType learning_rate) {
+    auto start = Clock::now();
     const LearnFloatType local_learning_rate =
         learning_rate * learning_rate_scale_;
     for (IndexType b = 0; b < batch_->size(); ++b) {
@@ -160,31 +165,6 @@ class Trainer<FeatureTransformer> {
     }
     cblas_saxpy(kHalfDimensions, -local_learning_rate,
                 biases_diff_, 1, biases_, 1);
-#pragma omp parallel
-    {
-#if defined(_OPENMP)
-      const IndexType num_threads = omp_get_num_threads();
-      const IndexType thread_index = omp_get_thread_num();
-#endif
-      for (IndexType b = 0; b < batch_->size(); ++b) {
-        const IndexType batch_offset = kOutputDimensions * b;
-        for (IndexType c = 0; c < 2; ++c) {
-          const IndexType output_offset = batch_offset + kHalfDimensions * c;
-          for (const auto& feature : (*batch_)[b].training_features[c]) {
-#if defined(_OPENMP)
-            if (feature.GetIndex() % num_threads != thread_index) continue;
-#endif
-            const IndexType weights_offset =
-                kHalfDimensions * feature.GetIndex();
-            const auto scale = static_cast<LearnFloatType>(
-                effective_learning_rate / feature.GetCount());
-            cblas_saxpy(kHalfDimensions, -scale,
-                        &gradients_[output_offset], 1,
-                        &weights_[weights_offset], 1);
-          }
-        }
-      }
-    }
 #else
     for (IndexType i = 0; i < kHalfDimensions; ++i) {
       biases_diff_[i] *= momentum_;
@@ -201,29 +181,70 @@ class Trainer<FeatureTransformer> {
     for (IndexType i = 0; i < kHalfDimensions; ++i) {
       biases_[i] -= local_learning_rate * biases_diff_[i];
     }
+#endif
+    bias_time_ += Clock::now() - start;
+    start = Clock::now();
+
+    // Bucket the (feature, example) pairs of the batch by feature index with a
+    // counting sort. Within a bucket the pairs stay in the order of the batch.
+    feature_ends_.assign(kInputDimensions + 1, 0);
+    for (const auto& example : *batch_) {
+      for (IndexType c = 0; c < 2; ++c) {
+        for (const auto& feature : example.training_features[c]) {
+          ++feature_ends_[feature.GetIndex() + 1];
+        }
+      }
+    }
+    active_features_.clear();
+    for (IndexType i = 0; i < kInputDimensions; ++i) {
+      if (feature_ends_[i + 1] != 0) {
+        active_features_.push_back(i);
+        observed_features.set(i);
+        dirty_features_.set(i);
+      }
+      feature_ends_[i + 1] += feature_ends_[i];
+    }
+    weight_gradients_.resize(feature_ends_[kInputDimensions]);
     for (IndexType b = 0; b < batch_->size(); ++b) {
       const IndexType batch_offset = kOutputDimensions * b;
       for (IndexType c = 0; c < 2; ++c) {
         const IndexType output_offset = batch_offset + kHalfDimensions * c;
         for (const auto& feature : (*batch_)[b].training_features[c]) {
-          const IndexType weights_offset = kHalfDimensions * feature.GetIndex();
-          const auto scale = static_cast<LearnFloatType>(
-              effective_learning_rate / feature.GetCount());
-          for (IndexType i = 0; i < kHalfDimensions; ++i) {
-            weights_[weights_offset + i] -=
-                scale * gradients_[output_offset + i];
-          }
+          // feature_ends_[i] ends up at the end of the bucket of feature i
+          weight_gradients_[feature_ends_[feature.GetIndex()]++] = {
+              static_cast<LearnFloatType>(
+                  effective_learning_rate / feature.GetCount()),
+              output_offset};
         }
       }
     }
-#endif
-    for (IndexType b = 0; b < batch_->size(); ++b) {
-      for (IndexType c = 0; c < 2; ++c) {
-        for (const auto& feature : (*batch_)[b].training_features[c]) {
-          observed_features.set(feature.GetIndex());
+    bucket_time_ += Clock::now() - start;
+    start = Clock::now();
+
+    // Each column of the weight matrix is updated by a single thread, in the
+    // order of the batch, so the result does not depend on the number of threads.
+    const int num_active_features = static_cast<int>(active_features_.size());
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int k = 0; k < num_active_features; ++k) {
+      const IndexType index = active_features_[k];
+      const IndexType weights_offset = kHalfDimensions * index;
+      const std::uint32_t begin = index == 0 ? 0 : feature_ends_[index - 1];
+      for (std::uint32_t j = begin; j < feature_ends_[index]; ++j) {
+        const auto& gradient = weight_gradients_[j];
+#if defined(USE_BLAS)
+        cblas_saxpy(kHalfDimensions, -gradient.scale,
+                    &gradients_[gradient.output_offset], 1,
+                    &weights_[weights_offset], 1);
+#else
+        for (IndexType i = 0; i < kHalfDimensions; ++i) {
+          weights_[weights_offset + i] -=
+              gradient.scale * gradients_[gradient.output_offset + i];
         }
+#endif
       }
     }
+    weight_time_ += Clock::now() - start;
+    ++num_batches_;
   }
 
  private:
@@ -242,30 +263,62 @@ class Trainer<FeatureTransformer> {
               std::numeric_limits<LearnFloatType>::max());
     std::fill(std::begin(max_activations_), std::end(max_activations_),
               std::numeric_limits<LearnFloatType>::lowest());
+
+    // Expand the factorizer once for all raw features
+    std::vector<TrainingFeature> training_features;
+    training_feature_ends_.reserve(RawFeatures::kDimensions);
+    for (IndexType j = 0; j < RawFeatures::kDimensions; ++j) {
+      training_features.clear();
+      Features::Factorizer<RawFeatures>::AppendTrainingFeatures(
+          j, &training_features);
+      for (const auto& feature : training_features) {
+        training_feature_indices_.push_back(feature.GetIndex());
+      }
+      training_feature_ends_.push_back(
+          static_cast<std::uint32_t>(training_feature_indices_.size()));
+    }
+
     DequantizeParameters();
   }
 
   // Weight saturation and parameterization
+  // Only the columns of the raw features that have a training feature updated
+  // since the last call (dirty_features_) are written.
   void QuantizeParameters() {
+    const auto start = Clock::now();
     for (IndexType i = 0; i < kHalfDimensions; ++i) {
       target_layer_->biases_[i] =
           Round<typename LayerType::BiasType>(biases_[i] * kBiasScale);
     }
-    std::vector<TrainingFeature> training_features;
-#pragma omp parallel for private(training_features)
+    std::uint64_t num_columns = 0;
+#pragma omp parallel for schedule(dynamic, 256) reduction(+:num_columns)
     for (IndexType j = 0; j < RawFeatures::kDimensions; ++j) {
-      training_features.clear();
-      Features::Factorizer<RawFeatures>::AppendTrainingFeatures(
-          j, &training_features);
-      for (IndexType i = 0; i < kHalfDimensions; ++i) {
-        double sum = 0.0;
-        for (const auto& feature : training_features) {
-          sum += weights_[kHalfDimensions * feature.GetIndex() + i];
+      const std::uint32_t begin = j == 0 ? 0 : training_feature_ends_[j - 1];
+      const std::uint32_t end = training_feature_ends_[j];
+      bool dirty = false;
+      for (std::uint32_t k = begin; k < end; ++k) {
+        dirty |= dirty_features_.test(training_feature_indices_[k]);
+      }
+      if (!dirty) continue;
+      ++num_columns;
+      // Summed a training feature at a time, in the same order for each element
+      double sum[kHalfDimensions] = {};
+      for (std::uint32_t k = begin; k < end; ++k) {
+        const LearnFloatType* weights =
+            &weights_[kHalfDimensions * training_feature_indices_[k]];
+        for (IndexType i = 0; i < kHalfDimensions; ++i) {
+          sum[i] += weights[i];
         }
+      }
+      for (IndexType i = 0; i < kHalfDimensions; ++i) {
         target_layer_->weights_[kHalfDimensions * j + i] =
-            Round<typename LayerType::WeightType>(sum * kWeightScale);
+            Round<typename LayerType::WeightType>(sum[i] * kWeightScale);
       }
     }
+    dirty_features_.reset();
+    quantize_time_ += Clock::now() - start;
+    quantized_columns_ += num_columns;
+    ++num_quantizations_;
   }
 
   // read parameterized integer
@@ -280,6 +333,7 @@ class Trainer<FeatureTransformer> {
           target_layer_->weights_[i] / kWeightScale);
     }
     std::fill(std::begin(biases_diff_), std::end(biases_diff_), +kZero);
+    dirty_features_.set();
   }
 
   // Set the weight corresponding to the feature that does not appear in the learning data to 0
@@ -288,6 +342,7 @@ class Trainer<FeatureTransformer> {
       if (!observed_features.test(i)) {
         std::fill(std::begin(weights_) + kHalfDimensions * i,
                   std::begin(weights_) + kHalfDimensions * (i + 1), +kZero);
+        dirty_features_.set(i);
       }
     }
     QuantizeParameters();
@@ -318,8 +373,34 @@ class Trainer<FeatureTransformer> {
               std::numeric_limits<LearnFloatType>::max());
     std::fill(std::begin(max_activations_), std::end(max_activations_),
               std::numeric_limits<LearnFloatType>::lowest());
+
+    if (num_batches_ != 0) {
+      const auto per_batch = [&](Clock::duration time) {
+        return std::chrono::duration<double, std::milli>(time).count() /
+               num_batches_;
+      };
+      std::cout << "INFO: feature transformer time per batch (ms): propagate = "
+                << per_batch(propagate_time_)
+                << ", bias = " << per_batch(bias_time_)
+                << ", bucket = " << per_batch(bucket_time_)
+                << ", weights = " << per_batch(weight_time_)
+                << " (" << num_batches_ << " batches)" << std::endl;
+    }
+    if (num_quantizations_ != 0) {
+      std::cout << "INFO: feature transformer quantization: "
+                << std::chrono::duration<double, std::milli>(quantize_time_).count() /
+                   num_quantizations_
+                << " ms, " << quantized_columns_ / num_quantizations_
+                << " (out of " << RawFeatures::kDimensions
+                << ") columns per update" << std::endl;
+    }
+    propagate_time_ = bias_time_ = bucket_time_ = weight_time_ = Clock::duration::zero();
+    quantize_time_ = Clock::duration::zero();
+    num_batches_ = num_quantizations_ = quantized_columns_ = 0;
   }
 
+  using Clock = std::chrono::steady_clock;
+
   // number of input/output dimensions
   static constexpr IndexType kInputDimensions =
       Features::Factorizer<RawFeatures>::GetDimensions();
@@ -354,9 +435,28 @@ class Trainer<FeatureTransformer> {
   // Forward propagation buffer
   std::vector<LearnFloatType> output_;
 
+  // Gradient of a column of the weight matrix from one example
+  struct WeightGradient {
+    LearnFloatType scale;
+    IndexType output_offset;
+  };
+
+  // (feature, example) pairs of the batch bucketed by feature index
+  std::vector<WeightGradient> weight_gradients_;
+  std::vector<std::uint32_t> feature_ends_;
+  std::vector<IndexType> active_features_;
+
   // Features that appeared in the training data
   std::bitset<kInputDimensions> observed_features;
 
+  // Training features whose weights changed since the last QuantizeParameters()
+  std::bitset<kInputDimensions> dirty_features_;
+
+  // Indices of the training features of each raw feature, ending at
+  // training_feature_ends_[j] for the raw feature j
+  std::vector<IndexType> training_feature_indices_;
+  std::vector<std::uint32_t> training_feature_ends_;
+
   // hyper parameter
   LearnFloatType momentum_;
   LearnFloatType learning_rate_scale_;
@@ -366,6 +466,16 @@ class Trainer<FeatureTransformer> {
   LearnFloatType max_pre_activation_;
   LearnFloatType min_activations_[kHalfDimensions];
   LearnFloatType max_activations_[kHalfDimensions];
+
+  // Time spent in each phase since the last CheckHealth()
+  Clock::duration propagate_time_{};
+  Clock::duration bias_time_{};
+  Clock::duration bucket_time_{};
+  Clock::duration weight_time_{};
+  Clock::duration quantize_time_{};
+  std::uint64_t num_batches_ = 0;
+  std::uint64_t num_quantizations_ = 0;
+  std::uint64_t quantized_columns_ = 0;
 };
 
 }  // namespace NNUE
@@ -896,6 +896,10 @@ namespace {
 Value Eval::evaluate(const Position& pos) {
   return Evaluation<NO_TRACE>(pos).value();
 }
+
+Value Eval::evaluate(const Position& pos, bool) {
+  return evaluate(pos);
+}
 #endif  // defined(EVAL_NNUE)
 
 
@@ -33,6 +33,10 @@ std::string trace(const Position& pos);
 
 Value evaluate(const Position& pos);
 
+// Evaluation used by the search. pvNode lets an NNUE ensemble spend more time
+// on the positions that matter most; otherwise it is the same as evaluate(pos).
+Value evaluate(const Position& pos, bool pvNode);
+
 void evaluate_with_no_return(const Position& pos);
 
 Value compute_eval(const Position& pos);
@@ -43,6 +47,26 @@ Value compute_eval(const Position& pos);
 // (However, if isready is sent again after EvalDir (evaluation function folder) has been changed, read it again.)
 void load_eval();
 
+#if defined(EVAL_NNUE) && defined(USE_EVAL_HASH)
+// Prefetch the eval hash bucket that evaluate() reads for the position, called
+// right after do_move() so that the load overlaps with the search work before it.
+void prefetch_evaluation(const Position& pos);
+#endif
+
+#if defined(EVAL_NNUE)
+// Read the EnsemblePV, EnsembleMargin and EnsembleWeight* options
+void update_ensemble_policy();
+#endif
+
+#if defined(USE_EVAL_HASH)
+// Set the size of the hash table of evaluation values in MB (EvalHash option).
+// The size is rounded down to a power of 2, and 0 disables the table.
+void resize_evalhash(size_t mbSize);
+
+// Clear the hash table of evaluation values
+void clear_evalhash();
+#endif
+
 static uint64_t calc_check_sum() {return 0;}
 
 static void print_softname(uint64_t check_sum) {}
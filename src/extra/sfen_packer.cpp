@@ -51,10 +51,16 @@ struct BitStream
 
   // write n bits of data
   // Data shall be written out from the lower order of d.
-  void write_n_bit(int d, int n)
+  // The memory is cleared to 0, so the bits (n <= 56) are or-ed in a byte at a time.
+  // Only the bytes up to the last bit set are touched, so nothing is written past the data.
+  void write_n_bit(uint64_t d, int n)
   {
-    for (int i = 0; i <n; ++i)
-      write_one_bit(d & (1 << i));
+    assert(n <= 56);
+    uint64_t bits = (d & ((uint64_t(1) << n) - 1)) << (bit_cursor & 7);
+    for (uint8_t* p = data + bit_cursor / 8; bits; bits >>= 8)
+      *p++ |= uint8_t(bits);
+
+    bit_cursor += n;
   }
 
   // read n bits of data
@@ -170,15 +176,28 @@ struct SfenPacker
       stream.write_n_bit(pos.king_square(c), 6);
 
     // Write the pieces on the board other than the kings.
+    // The squares are written from A8 to H1, an empty square as a single 0 bit.
+    // Only the occupied squares of a rank are visited, and the rank (at most
+    // 40 bits) is written at once.
     for (Rank r = RANK_8; r >= RANK_1; --r)
     {
-      for (File f = FILE_A; f <= FILE_H; ++f)
+      uint64_t code = 0;
+      int extra = 0; // bits of the pieces so far beyond 1 bit per square, -1 for a king
+      Bitboard b = pos.pieces() & rank_bb(r);
+      while (b)
       {
-        Piece pc = pos.piece_on(make_square(f, r));
+        const Square sq = pop_lsb(&b);
+        const Piece pc = pos.piece_on(sq);
         if (type_of(pc) == KING)
+        {
+          --extra;
           continue;
-        write_board_piece_to_stream(pc);
+        }
+        const auto c = huffman_table[type_of(pc)];
+        code |= uint64_t(c.code | (color_of(pc) << c.bits)) << (file_of(sq) + extra);
+        extra += c.bits;
       }
+      stream.write_n_bit(code, FILE_NB + extra);
     }
 
     // TODO(someone): Support chess960.
@@ -242,6 +261,10 @@ struct SfenPacker
         if (huffman_table[pr].code == code
           && huffman_table[pr].bits == bits)
           goto Found;
+
+      // The codes are at most 4 bits. Others come only from broken data.
+      if (bits == 4)
+        return PIECE_NB;
     }
   Found:;
     if (pr == NO_PIECE_TYPE)
@@ -287,15 +310,16 @@ int Position::set_from_packed_sfen(const PackedSfen& sfen , StateInfo * si, Thre
   pieceList[B_KING][0] = SQUARE_NB;
 
 	// First the position of the ball
-	if (mirror)
-	{
-		for (auto c : Colors)
-			board[Mir((Square)stream.read_n_bit(6))] = make_piece(c, KING);
-	}
-	else
+	for (auto c : Colors)
 	{
-		for (auto c : Colors)
-			board[stream.read_n_bit(6)] = make_piece(c, KING);
+		Square ksq = (Square)stream.read_n_bit(6);
+		if (mirror)
+			ksq = Mir(ksq);
+
+		// Broken data may put both balls on one square.
+		if (board[ksq] != NO_PIECE)
+			return 1;
+		board[ksq] = make_piece(c, KING);
 	}
 
   // Piece placement
@@ -325,6 +349,11 @@ int Position::set_from_packed_sfen(const PackedSfen& sfen , StateInfo * si, Thre
       if (pc == NO_PIECE)
         continue;
 
+      // Broken data may have an unknown code or more pieces than the lists hold.
+      if (pc == PIECE_NB
+        || (type_of(pc) != KING && (next_piece_number == PIECE_NUMBER_KING || pieceCount[pc] == 16)))
+        return 1;
+
       put_piece(Piece(pc), sq);
 
       // update evalList
@@ -349,22 +378,30 @@ int Position::set_from_packed_sfen(const PackedSfen& sfen , StateInfo * si, Thre
   st->castlingRights = 0;
   if (stream.read_one_bit()) {
     Square rsq;
-    for (rsq = relative_square(WHITE, SQ_H1); piece_on(rsq) != W_ROOK; --rsq) {}
+    for (rsq = relative_square(WHITE, SQ_H1); rsq > relative_square(WHITE, SQ_A1) && piece_on(rsq) != W_ROOK; --rsq) {}
+    if (piece_on(rsq) != W_ROOK)
+      return 1;
     set_castling_right(WHITE, rsq);
   }
   if (stream.read_one_bit()) {
     Square rsq;
-    for (rsq = relative_square(WHITE, SQ_A1); piece_on(rsq) != W_ROOK; ++rsq) {}
+    for (rsq = relative_square(WHITE, SQ_A1); rsq < relative_square(WHITE, SQ_H1) && piece_on(rsq) != W_ROOK; ++rsq) {}
+    if (piece_on(rsq) != W_ROOK)
+      return 1;
     set_castling_right(WHITE, rsq);
   }
   if (stream.read_one_bit()) {
     Square rsq;
-    for (rsq = relative_square(BLACK, SQ_H1); piece_on(rsq) != B_ROOK; --rsq) {}
+    for (rsq = relative_square(BLACK, SQ_H1); rsq > relative_square(BLACK, SQ_A1) && piece_on(rsq) != B_ROOK; --rsq) {}
+    if (piece_on(rsq) != B_ROOK)
+      return 1;
     set_castling_right(BLACK, rsq);
   }
   if (stream.read_one_bit()) {
     Square rsq;
-    for (rsq = relative_square(BLACK, SQ_A1); piece_on(rsq) != B_ROOK; ++rsq) {}
+    for (rsq = relative_square(BLACK, SQ_A1); rsq < relative_square(BLACK, SQ_H1) && piece_on(rsq) != B_ROOK; ++rsq) {}
+    if (piece_on(rsq) != B_ROOK)
+      return 1;
     set_castling_right(BLACK, rsq);
   }
 
@@ -376,7 +413,8 @@ int Position::set_from_packed_sfen(const PackedSfen& sfen , StateInfo * si, Thre
     }
     st->epSquare = ep_square;
 
-    if (!(attackers_to(st->epSquare) & pieces(sideToMove, PAWN))
+    if (relative_rank(sideToMove, st->epSquare) != RANK_6
+      || !(attackers_to(st->epSquare) & pieces(sideToMove, PAWN))
       || !(pieces(~sideToMove, PAWN) & (st->epSquare + pawn_push(~sideToMove))))
       st->epSquare = SQ_NONE;
   }
@@ -219,6 +219,9 @@ namespace Learner
 		// 32 + 2 + 2 + 2 + 1 + 1 = 40bytes
 	};
 
+	// Phase array: PSVector stands for packed sfen vector.
+	typedef std::vector<PackedSfenValue> PSVector;
+
 	// Type that returns the reading line and the evaluation value at that time
 	// Used in Learner::search(), Learner::qsearch().
 	typedef std::pair<Value, std::vector<Move> > ValueAndPV;
@@ -21,6 +21,7 @@
 
 #include "learn.h"
 #include "multi_think.h"
+#include "sfen_stream.h"
 #include "../uci.h"
 
 // evaluate header for learning
@@ -57,6 +58,7 @@
 #include <unordered_set>
 #include <iomanip>
 #include <list>
+#include <algorithm>
 #include <cmath>	// std::exp(),std::pow(),std::log()
 #include <cstring>	// memcpy()
 
@@ -81,8 +83,10 @@
 #include "multi_think.h"
 
 #if defined(EVAL_NNUE)
+#include "../eval/nnue/evaluate_nnue.h"
 #include "../eval/nnue/evaluate_nnue_learner.h"
 #include <shared_mutex>
+#include <condition_variable>
 #endif
 
 using namespace std;
@@ -124,9 +128,6 @@ void init_fibonacci() {
 namespace Learner
 {
 
-// Phase array: PSVector stands for packed sfen vector.
-typedef std::vector<PackedSfenValue> PSVector;
-
 bool use_draw_in_training_data_generation = false;
 bool use_draw_in_training = false;
 bool use_draw_in_validation = false;
@@ -144,11 +145,13 @@ struct SfenWriter
 	{
 		sfen_buffers_pool.reserve((size_t)thread_num * 10);
 		sfen_buffers.resize(thread_num);
+		codecs.resize(thread_num);
 
 		// When performing additional learning, the quality of the teacher generated after learning the evaluation function does not change much and I want to earn more teacher positions.
 		// Since it is preferable that old teachers also use it, it has such a specification.
-		fs.open(filename, ios::out | ios::binary | ios::app);
+		fs.open(filename, true, Threads.main());
 		filename_ = filename;
+		compressed = fs.is_compressed();
 
 		finished = false;
 	}
@@ -162,6 +165,7 @@ struct SfenWriter
 		// all buffers should be empty since file_worker_thread has written all..
 		for (auto p : sfen_buffers) { assert(p == nullptr); }
 		assert(sfen_buffers_pool.empty());
+		assert(sfen_blocks_pool.empty());
 	}
 
 	// For each thread, flush the file by this number of phases.
@@ -190,12 +194,7 @@ struct SfenWriter
 		if (buf->size() >= SFEN_WRITE_SIZE)
 		{
 			// If you load it in sfen_buffers_pool, the worker will do the rest.
-
-			// Mutex lock is required when changing the contents of sfen_buffers_pool.
-			std::unique_lock<std::mutex> lk(mutex);
-			sfen_buffers_pool.push_back(buf);
-
-			buf = nullptr;
+			push_buffer(thread_id);
 			// If you set buf == nullptr, the buffer will be allocated the next time this function is called.
 		}
 	}
@@ -203,13 +202,42 @@ struct SfenWriter
 	// Move what remains in the buffer for your thread to a buffer for writing to a file.
 	void finalize(size_t thread_id)
 	{
-		std::unique_lock<std::mutex> lk(mutex);
-
 		auto& buf = sfen_buffers[thread_id];
 
 		// There is a case that buf==nullptr, so that check is necessary.
 		if (buf && buf->size() != 0)
-			sfen_buffers_pool.push_back(buf);
+			push_buffer(thread_id);
+
+		delete buf;
+		buf = nullptr;
+	}
+
+	// Hand over the buffer of the thread to file_write_worker().
+	// When writing a compressed file, the calling thread compresses it as one block,
+	// so that the compression is spread over the threads generating the phases.
+	void push_buffer(size_t thread_id)
+	{
+		auto& buf = sfen_buffers[thread_id];
+
+		if (compressed)
+		{
+			auto& codec = codecs[thread_id];
+			if (!codec)
+				codec.reset(new SfenBlockCodec(Threads[thread_id]));
+
+			SfenBlock* block = new SfenBlock();
+			codec->encode(&(*buf)[0], buf->size(), *block);
+			delete buf;
+			buf = nullptr;
+
+			std::unique_lock<std::mutex> lk(mutex);
+			sfen_blocks_pool.push_back(block);
+			return;
+		}
+
+		// Mutex lock is required when changing the contents of sfen_buffers_pool.
+		std::unique_lock<std::mutex> lk(mutex);
+		sfen_buffers_pool.push_back(buf);
 
 		buf = nullptr;
 	}
@@ -232,59 +260,76 @@ struct SfenWriter
 			fs.flush();
 		};
 
-		while (!finished || sfen_buffers_pool.size())
+		// Count the written phases, switch the file every save_every phases and show the progress.
+		auto after_write = [&](uint64_t size)
+		{
+			sfen_write_count += size;
+
+#if 1
+			// Add the processed number here, and if it exceeds save_every, change the file name and reset this counter.
+			save_every_counter += size;
+			if (save_every_counter >= save_every)
+			{
+				save_every_counter = 0;
+				// Change the file name.
+
+				fs.close();
+
+				// Sequential number attached to the file
+				int n = (int)(sfen_write_count / save_every);
+				// Rename the file and open it again. Add ios::app in consideration of overwriting. (Depending on the operation, it may not be necessary.)
+				// The number is put before the extension of a compressed file.
+				string filename = add_sfen_file_name_suffix(filename_, "_" + std::to_string(n));
+				fs.open(filename, true, Threads.main());
+				cout << endl << "output sfen file = " << filename << endl;
+			}
+#endif
+
+			// Output'.' every time when writing a game record.
+			std::cout << ".";
+
+			// Output the number of phases processed every 40 times
+			// Finally, the remainder of the teacher phase of each thread is written out, so halfway numbers are displayed, but is it okay?
+			// If you overuse the threads to the maximum number of logical cores, the console will be clogged, so it may be a little more loose.
+			if ((++time_stamp_count % 40) == 0)
+				output_status();
+		};
+
+		while (!finished || sfen_buffers_pool.size() || sfen_blocks_pool.size())
 		{
 			vector<PSVector*> buffers;
+			vector<SfenBlock*> blocks;
 			{
 				std::unique_lock<std::mutex> lk(mutex);
 
 				// copy the whole
 				buffers = sfen_buffers_pool;
 				sfen_buffers_pool.clear();
+				blocks = sfen_blocks_pool;
+				sfen_blocks_pool.clear();
 			}
 
 			// sleep() if you didn't get anything
-			if (!buffers.size())
+			if (!buffers.size() && !blocks.size())
 				sleep(100);
-			else
-			{
-				for (auto ptr : buffers)
-				{
-					fs.write((const char*)&((*ptr)[0]), sizeof(PackedSfenValue) * ptr->size());
-
-					sfen_write_count += ptr->size();
-
-#if 1
-					// Add the processed number here, and if it exceeds save_every, change the file name and reset this counter.
-					save_every_counter += ptr->size();
-					if (save_every_counter >= save_every)
-					{
-						save_every_counter = 0;
-						// Change the file name.
 
-						fs.close();
-
-						// Sequential number attached to the file
-						int n = (int)(sfen_write_count / save_every);
-						// Rename the file and open it again. Add ios::app in consideration of overwriting. (Depending on the operation, it may not be necessary.)
-						string filename = filename_ + "_" + std::to_string(n);
-						fs.open(filename, ios::out | ios::binary | ios::app);
-						cout << endl << "output sfen file = " << filename << endl;
-					}
-#endif
+			// Only one of them is used, depending on the format of the file.
+			for (auto block : blocks)
+			{
+				fs.write(*block);
+				after_write(block->size);
 
-					// Output'.' every time when writing a game record.
-					std::cout << ".";
+				// Since this memory is unnecessary, release it at this timing.
+				delete block;
+			}
 
-					// Output the number of phases processed every 40 times
-					// Finally, the remainder of the teacher phase of each thread is written out, so halfway numbers are displayed, but is it okay?
-					// If you overuse the threads to the maximum number of logical cores, the console will be clogged, so it may be a little more loose.
-					if ((++time_stamp_count % 40) == 0)
-						output_status();
+			for (auto ptr : buffers)
+			{
+				fs.write(&((*ptr)[0]), ptr->size());
+				after_write(ptr->size());
 
-					// Since this memory is unnecessary, release it at this timing.
-					delete ptr;
-				}
+				// Since this memory is unnecessary, release it at this timing.
+				delete ptr;
 			}
 		}
 
@@ -297,11 +342,15 @@ struct SfenWriter
 
 private:
 
-	fstream fs;
+	// Plain .bin, or compressed if the file name ends with kCompressedSfenExtension
+	SfenOutputStream fs;
 
 	// File name passed in the constructor
 	std::string filename_;
 
+	// Whether filename_ is a compressed file
+	bool compressed;
+
 	// Add the processed number here, and if it exceeds save_every, change the file name and reset this counter.
 	uint64_t save_every_counter = 0;
 
@@ -320,6 +369,10 @@ private:
 	std::vector<PSVector*> sfen_buffers;
 	std::vector<PSVector*> sfen_buffers_pool;
 
+	// Compressed blocks for writing and the codec of each thread (compressed file only)
+	std::vector<SfenBlock*> sfen_blocks_pool;
+	std::vector<std::unique_ptr<SfenBlockCodec>> codecs;
+
 	// Mutex required to access sfen_buffers_pool
 	std::mutex mutex;
 
@@ -985,7 +1038,7 @@ void gen_sfen(Position&, istringstream& is)
 			return ss.str();
 		};
 		// I don't want to wear 64bit numbers by accident, so I'm going to make a 64bit number 2 just in case.
-		output_file_name = output_file_name + "_" + to_hex(r.rand<uint64_t>()) + to_hex(r.rand<uint64_t>());
+		output_file_name = add_sfen_file_name_suffix(output_file_name, "_" + to_hex(r.rand<uint64_t>()) + to_hex(r.rand<uint64_t>()));
 	}
 
 	std::cout << "gensfen : " << endl
@@ -1228,6 +1281,12 @@ struct SfenReader
 		end_of_files = false;
 		no_shuffle = false;
 		stop_flag = false;
+		use_mmap = false;
+		mmap_block_size = 1024;
+		mmap_epochs = 1;
+		mapped_sfens.resize(thread_num);
+		mapped_decoded.resize(thread_num);
+		mapped_codecs.resize(thread_num);
 
 		hash.resize(READ_SFEN_HASH_SIZE);
 	}
@@ -1241,6 +1300,8 @@ struct SfenReader
 			delete p;
 		for (auto p : packed_sfens_pool)
 			delete p;
+		for (auto& f : mapped_files)
+			unmap_file(f.addr, f.size);
 	}
 
 	// number of phases used for calculation such as mse
@@ -1273,12 +1334,13 @@ struct SfenReader
 
 	void read_validation_set(const string file_name, int eval_limit)
 	{
-		ifstream fs(file_name, ios::binary);
+		SfenInputStream fs;
+		fs.open(file_name, Threads.main());
 
-		while (fs)
+		while (true)
 		{
 			PackedSfenValue p;
-			if (fs.read((char*)&p, sizeof(PackedSfenValue)))
+			if (fs.read(p))
 			{
 				if (eval_limit < abs(p.score))
 					continue;
@@ -1302,6 +1364,18 @@ struct SfenReader
 	// [ASYNC] Thread returns one aspect. Otherwise returns false.
 	bool read_to_thread_buffer(size_t thread_id, PackedSfenValue& ps)
 	{
+		if (use_mmap)
+		{
+			// The thread buffer only holds pointers into the mapped files.
+			auto& thread_ptrs = mapped_sfens[thread_id];
+			if (thread_ptrs.empty() && !read_mapped_blocks(thread_id))
+				return false;
+
+			ps = *thread_ptrs.back();
+			thread_ptrs.pop_back();
+			return true;
+		}
+
 		// If there are any positions left in the thread buffer, retrieve one and return it.
 		auto& thread_ps = packed_sfens[thread_id];
 
@@ -1361,9 +1435,166 @@ struct SfenReader
 	}
 
 	// Start a thread that loads the phase file in the background.
+	// With use_mmap, the files are mapped instead and no thread is needed.
 	void start_file_read_worker()
 	{
-		file_worker_thread = std::thread([&] { this->file_read_worker(); });
+		if (use_mmap)
+			open_mapped_files();
+		else
+			file_worker_thread = std::thread([&] { this->file_read_worker(); });
+	}
+
+	// Map all the teacher files read-only. The phases are then visited in the order of
+	// a random permutation of blocks of mmap_block_size phases, drawn again for each epoch,
+	// so the shuffle covers all files while each block is still read sequentially.
+	// The blocks of a compressed file are those of the file.
+	void open_mapped_files()
+	{
+		// filenames is in reverse order because file_read_worker() pops from the back.
+		for (auto it = filenames.rbegin(); it != filenames.rend(); ++it)
+		{
+			MappedSfenFile f;
+			f.addr = map_file(*it, f.size);
+			if (!f.addr)
+			{
+				cout << "Error! : can't map " << *it << endl;
+				continue;
+			}
+			f.data = (const PackedSfenValue*)f.addr;
+			f.records = f.size / sizeof(PackedSfenValue);
+
+			uint64_t end_of_blocks;
+			uint64_t blocks = (f.records + mmap_block_size - 1) / mmap_block_size;
+			if (read_sfen_block_index((const uint8_t*)f.addr, f.size, f.compressed_blocks, end_of_blocks))
+			{
+				f.records = 0;
+				for (const auto& block : f.compressed_blocks)
+					f.records += block.size;
+				blocks = f.compressed_blocks.size();
+			}
+			cout << "map filename = " << *it << " , " << f.records << " sfens" << endl;
+
+			block_ends.push_back((block_ends.empty() ? 0 : block_ends.back()) + blocks);
+			mapped_files.push_back(f);
+		}
+
+		block_order.resize(block_ends.empty() ? 0 : block_ends.back());
+		next_block = 0;
+		epoch = 0;
+		shuffle_blocks();
+	}
+
+	// Draw the block order of a new epoch. Called with the mutex locked (or before the workers start).
+	void shuffle_blocks()
+	{
+		for (uint64_t i = 0; i < block_order.size(); ++i)
+			block_order[i] = i;
+
+		if (!no_shuffle)
+		{
+			auto size = block_order.size();
+			for (size_t i = 0; i < size; ++i)
+				swap(block_order[i], block_order[(size_t)(prng.rand((uint64_t)size - i) + i)]);
+		}
+	}
+
+	// [ASYNC] Fill the thread buffer with pointers to the phases of the next blocks
+	// and shuffle them, so that a thread buffer mixes about THREAD_BUFFER_SIZE phases
+	// from unrelated places of the files.
+	bool read_mapped_blocks(size_t thread_id)
+	{
+		auto& thread_ptrs = mapped_sfens[thread_id];
+		auto& decoded = mapped_decoded[thread_id];
+
+		// Only the blocks and a seed for the shuffle are taken with the mutex locked.
+		// The blocks are decoded and shuffled after unlocking it.
+		// Blocks that fail to decode leave the buffer empty, so pick again.
+		while (thread_ptrs.empty())
+		{
+			std::vector<std::pair<size_t, uint64_t>> picked; // (file, block in the file)
+			uint64_t seed = 0;
+			{
+				std::unique_lock<std::mutex> lk(mutex);
+
+				size_t picked_records = 0;
+				while (picked_records < THREAD_BUFFER_SIZE)
+				{
+					if (next_block == block_order.size())
+					{
+						if (++epoch >= mmap_epochs)
+							break;
+
+						cout << "epoch = " << epoch << endl;
+						shuffle_blocks();
+						next_block = 0;
+					}
+
+					const uint64_t block = block_order[next_block++];
+					const size_t file = std::upper_bound(block_ends.begin(), block_ends.end(), block) - block_ends.begin();
+					const uint64_t index = block - (file ? block_ends[file - 1] : 0);
+					const auto& f = mapped_files[file];
+					picked.emplace_back(file, index);
+					picked_records += f.compressed_blocks.empty()
+						? std::min(mmap_block_size, f.records - index * mmap_block_size)
+						: f.compressed_blocks[index].size;
+				}
+
+				if (picked.empty())
+				{
+					if (!end_of_files)
+						cout << "..end of files." << endl;
+					end_of_files = true;
+					return false;
+				}
+
+				// PRNG does not take a zero seed
+				if (!no_shuffle)
+					seed = prng.rand<uint64_t>() | 1;
+			}
+
+			// The previous phases of the thread have all been taken, so decoded can be reused.
+			decoded.clear();
+			for (const auto& pick : picked)
+			{
+				const auto& f = mapped_files[pick.first];
+				if (f.compressed_blocks.empty())
+					continue;
+
+				auto& codec = mapped_codecs[thread_id];
+				if (!codec)
+					codec.reset(new SfenBlockCodec(Threads[thread_id]));
+
+				const auto& block = f.compressed_blocks[pick.second];
+				if (!codec->decode((const uint8_t*)f.addr + block.offset, block.data_size, block.size, decoded))
+					cout << "Error! : broken block at offset " << block.offset << endl;
+			}
+
+			for (const auto& pick : picked)
+			{
+				const auto& f = mapped_files[pick.first];
+				if (!f.compressed_blocks.empty())
+					continue;
+
+				const uint64_t first = pick.second * mmap_block_size;
+				const uint64_t last = std::min(first + mmap_block_size, f.records);
+				for (uint64_t i = first; i < last; ++i)
+					thread_ptrs.push_back(&f.data[i]);
+			}
+			for (const auto& psv : decoded)
+				thread_ptrs.push_back(&psv);
+
+			// With no_shuffle, the phases are taken from the back of the buffer as with file_read_worker().
+			if (!no_shuffle)
+			{
+				PRNG thread_prng(seed);
+				auto size = thread_ptrs.size();
+				for (size_t i = 0; i < size; ++i)
+					swap(thread_ptrs[i], thread_ptrs[(size_t)(thread_prng.rand((uint64_t)size - i) + i)]);
+			}
+		}
+
+		total_read += thread_ptrs.size();
+		return true;
 	}
 
 	// for file read-only threads
@@ -1371,8 +1602,7 @@ struct SfenReader
 	{
 		auto open_next_file = [&]()
 		{
-			if (fs.is_open())
-				fs.close();
+			fs.close();
 
 			// no more
 			if (filenames.size() == 0)
@@ -1382,9 +1612,10 @@ struct SfenReader
 			string filename = *filenames.rbegin();
 			filenames.pop_back();
 
-			fs.open(filename, ios::in | ios::binary);
-			cout << "open filename = " << filename << endl;
-			assert(fs);
+			if (!fs.open(filename, Threads.main()))
+				cout << "Error! : can't open " << filename << endl;
+			else
+				cout << "open filename = " << filename << endl;
 
 			return true;
 		};
@@ -1405,7 +1636,7 @@ struct SfenReader
 			while (sfens.size() < SFEN_READ_SIZE)
 			{
 				PackedSfenValue p;
-				if (fs.read((char*)&p, sizeof(PackedSfenValue)))
+				if (fs.read(p))
 				{
 					sfens.push_back(p);
 				} else
@@ -1484,6 +1715,15 @@ struct SfenReader
 
 	bool stop_flag;
 
+	// Read the teacher files through read-only memory mappings instead of file_read_worker().
+	bool use_mmap;
+
+	// Number of consecutive phases shuffled as a unit when use_mmap is set
+	uint64_t mmap_block_size;
+
+	// Number of passes over the mapped files (the loop option)
+	int mmap_epochs;
+
 	// Determine if it is a phase for calculating rmse.
 	// (The computational aspects of rmse should not be used for learning.)
 	bool is_for_rmse(Key key) const
@@ -1512,8 +1752,8 @@ protected:
 	atomic<bool> end_of_files;
 
 
-	// handle of sfen file
-	std::fstream fs;
+	// handle of sfen file (plain or compressed)
+	SfenInputStream fs;
 
 	// sfen for each thread
 	// (When the thread is used up, the thread should call delete to release it.)
@@ -1527,6 +1767,35 @@ protected:
 	// * Lock and access the mutex.
 	std::list<PSVector*> packed_sfens_pool;
 
+	// A teacher file mapped by open_mapped_files()
+	struct MappedSfenFile
+	{
+		void* addr;
+		size_t size;
+		const PackedSfenValue* data;
+		uint64_t records;
+
+		// Blocks of a compressed file. Empty for a plain file.
+		std::vector<SfenBlockRef> compressed_blocks;
+	};
+	std::vector<MappedSfenFile> mapped_files;
+
+	// Cumulative number of blocks up to and including each mapped file
+	std::vector<uint64_t> block_ends;
+
+	// Order in which the blocks are read in the current epoch and the next one to read
+	// * Lock and access the mutex.
+	std::vector<uint64_t> block_order;
+	uint64_t next_block;
+	int epoch;
+
+	// Phases of each thread, as pointers into mapped_files or mapped_decoded (use_mmap only)
+	std::vector<std::vector<const PackedSfenValue*>> mapped_sfens;
+
+	// Phases decoded from the compressed blocks of each thread and the codec of each thread
+	std::vector<PSVector> mapped_decoded;
+	std::vector<std::unique_ptr<SfenBlockCodec>> mapped_codecs;
+
 	// Hold the hash key so that the mse calculation phase is not used for learning.
 	std::unordered_set<Key> sfen_for_mse_hash;
 };
@@ -1559,6 +1828,12 @@ struct LearnerThink: public MultiThink
 	// Start a thread that loads the phase file in the background.
 	void start_file_read_worker() { sr.start_file_read_worker(); }
 
+#if defined(EVAL_NNUE)
+	// Start and stop the thread that updates the parameters when update_staleness > 0
+	void start_update_worker();
+	void stop_update_worker();
+#endif
+
 	// save merit function parameters to a file
 	bool save(bool is_final=false);
 
@@ -1610,6 +1885,42 @@ struct LearnerThink: public MultiThink
 	double latest_loss_sum;
 	uint64_t latest_loss_count;
 	std::string best_nn_directory;
+
+	// Double-buffered update of the parameters.
+	// With update_staleness > 0, a mini-batch is learned by update_worker() while
+	// the workers go on adding the examples of the next ones, evaluated with
+	// parameters that miss at most update_staleness updates. With 0, the workers
+	// wait while thread 0 updates the parameters.
+	int update_staleness = 0;
+
+	// Number of OpenMP threads used to learn a mini-batch (0: Threads)
+	int update_threads = 0;
+
+	std::thread update_thread;
+	std::mutex update_mutex;
+	std::condition_variable update_cv;
+	uint64_t updates_requested = 0;
+	uint64_t updates_applied = 0;
+	uint64_t update_epoch = 0;
+	bool update_quit = false;
+
+	// Set while the update thread waits to write the parameters, so that the
+	// workers do not keep it out by taking the read lock again and again
+	std::atomic<bool> update_writing{false};
+
+	void update_worker();
+
+	// Hand the examples added so far to the update thread, and wait until at most
+	// max_pending updates are not applied to the parameters used by evaluate()
+	void request_update(uint64_t epoch_);
+	void wait_for_updates(uint64_t max_pending);
+
+	// Throughput since the last loss output
+	TimePoint throughput_time = 0;
+	uint64_t throughput_done = 0;
+	std::atomic<uint64_t> update_count{0};
+	std::atomic<uint64_t> update_time{0};
+	std::atomic<uint64_t> idle_time{0};
 #endif
 
 	uint64_t eval_save_interval;
@@ -1636,6 +1947,18 @@ void LearnerThink::calc_loss(size_t thread_id, uint64_t done)
 	std::cout << sr.total_done << " sfens";
 	std::cout << ", iteration " << epoch;
 	std::cout << ", eta = " << Eval::get_eta() << ", ";
+
+	if (done != static_cast<uint64_t>(-1))
+	{
+		// idle: share of the time of the workers not spent on adding examples
+		const TimePoint elapsed = std::max<TimePoint>(now() - throughput_time, 1);
+		std::cout << "sfens/s = " << (sr.total_done - throughput_done) * 1000 / elapsed
+		          << ", update = " << update_time / std::max<uint64_t>(update_count, 1) << " ms"
+		          << ", idle = " << 100 * idle_time / (elapsed * (uint64_t)Options["Threads"]) << "%, ";
+		throughput_time = now();
+		throughput_done = sr.total_done;
+		update_count = update_time = idle_time = 0;
+	}
 #endif
 
 #if !defined(LOSS_FUNCTION_IS_ELMO_METHOD)
@@ -1840,6 +2163,86 @@ void LearnerThink::calc_loss(size_t thread_id, uint64_t done)
 }
 
 
+#if defined(EVAL_NNUE)
+void LearnerThink::start_update_worker()
+{
+	update_quit = false;
+	update_thread = std::thread([this] { update_worker(); });
+}
+
+void LearnerThink::stop_update_worker()
+{
+	if (!update_thread.joinable())
+		return;
+
+	// The mini-batches handed over are learned before the thread ends.
+	wait_for_updates(0);
+	{
+		std::lock_guard<std::mutex> lk(update_mutex);
+		update_quit = true;
+	}
+	update_cv.notify_all();
+	update_thread.join();
+}
+
+void LearnerThink::update_worker()
+{
+#if defined(_OPENMP)
+	omp_set_num_threads(update_threads ? update_threads : (int)Options["Threads"]);
+#endif
+
+	std::unique_lock<std::mutex> lk(update_mutex);
+	while (true)
+	{
+		update_cv.wait(lk, [this] { return update_quit || updates_applied < updates_requested; });
+		if (updates_applied == updates_requested)
+			break;
+
+		// The examples of all the mini-batches handed over so far are learned together.
+		const uint64_t requested = updates_requested;
+		const uint64_t epoch_ = update_epoch;
+		lk.unlock();
+
+		const TimePoint start = now();
+		Eval::NNUE::LearnExamples(epoch_);
+		{
+			update_writing = true;
+			lock_guard<shared_timed_mutex> write_lock(nn_mutex);
+			Eval::NNUE::QuantizeParameters();
+
+#if defined(USE_EVAL_HASH)
+			// The values stored in the eval hash were computed by the previous parameters
+			Eval::clear_evalhash();
+#endif
+			update_writing = false;
+		}
+		update_time += now() - start;
+		++update_count;
+
+		lk.lock();
+		updates_applied = requested;
+		update_cv.notify_all();
+	}
+}
+
+void LearnerThink::request_update(uint64_t epoch_)
+{
+	{
+		std::lock_guard<std::mutex> lk(update_mutex);
+		update_epoch = epoch_;
+		++updates_requested;
+	}
+	update_cv.notify_all();
+	wait_for_updates(update_staleness);
+}
+
+void LearnerThink::wait_for_updates(uint64_t max_pending)
+{
+	std::unique_lock<std::mutex> lk(update_mutex);
+	update_cv.wait(lk, [&] { return updates_requested - updates_applied <= max_pending; });
+}
+#endif
+
 void LearnerThink::thread_worker(size_t thread_id)
 {
 #if defined(_OPENMP)
@@ -1849,6 +2252,11 @@ void LearnerThink::thread_worker(size_t thread_id)
 	auto th = Threads[thread_id];
 	auto& pos = th->rootPos;
 
+#if defined(EVAL_NNUE)
+	// Start of the wait for the parameters to be updated, counted in idle_time
+	TimePoint idle_start = 0;
+#endif
+
 	while (true)
 	{
 	// display mse (this is sometimes done only for thread 0)
@@ -1856,17 +2264,23 @@ void LearnerThink::thread_worker(size_t thread_id)
 
 #if defined(EVAL_NNUE)
 		// Lock the evaluation function so that it is not used during updating.
+		// With update_staleness, the update thread writes it, so thread 0 locks it too.
 		shared_lock<shared_timed_mutex> read_lock(nn_mutex, defer_lock);
 		if (sr.next_update_weights <= sr.total_done ||
-		    (thread_id != 0 && !read_lock.try_lock()))
+		    ((thread_id != 0 || update_staleness) && (update_writing || !read_lock.try_lock())))
 #else
 		if (sr.next_update_weights <= sr.total_done)
 #endif
 		{
-			if (thread_id != 0)
+			if (thread_id != 0 || sr.next_update_weights > sr.total_done)
 			{
 				// Wait except thread_id == 0.
 
+#if defined(EVAL_NNUE)
+				if (!idle_start)
+					idle_start = now();
+#endif
+
 				if (stop_flag)
 					break;
 
@@ -1895,12 +2309,28 @@ void LearnerThink::thread_worker(size_t thread_id)
 				// Display epoch and current eta for debugging.
 				std::cout << "epoch = " << epoch << " , eta = " << Eval::get_eta() << std::endl;
 #else
+				if (update_staleness)
+				{
+					// The workers go on with the next mini-batch while this one is learned
+					const TimePoint start = now();
+					request_update(epoch);
+					idle_time += now() - start;
+				}
+				else
 				{
 					// update parameters
+					const TimePoint start = now();
 
 					// Lock the evaluation function so that it is not used during updating.
 					lock_guard<shared_timed_mutex> write_lock(nn_mutex);
 					Eval::NNUE::UpdateParameters(epoch);
+
+#if defined(USE_EVAL_HASH)
+					// The values stored in the eval hash were computed by the previous parameters
+					Eval::clear_evalhash();
+#endif
+					update_time += now() - start;
+					++update_count;
 				}
 #endif
 				++epoch;
@@ -1912,6 +2342,11 @@ void LearnerThink::thread_worker(size_t thread_id)
 				{
 					sr.save_count = 0;
 
+#if defined(EVAL_NNUE)
+					// Save the parameters with all the mini-batches so far
+					wait_for_updates(0);
+#endif
+
 					// During this time, as the gradient calculation proceeds, the value becomes too large and I feel annoyed, so stop other threads.
 					const bool converged = save();
 					if (converged)
@@ -1933,6 +2368,11 @@ void LearnerThink::thread_worker(size_t thread_id)
 					// Number of cases processed this time
 					uint64_t done = sr.total_done - sr.last_done;
 
+#if defined(EVAL_NNUE)
+					// The loss is calculated with all the mini-batches so far
+					wait_for_updates(0);
+#endif
+
 					// loss calculation
 					calc_loss(thread_id , done);
 
@@ -1949,9 +2389,23 @@ void LearnerThink::thread_worker(size_t thread_id)
 
 				// Since I was waiting for the update of this sr.next_update_weights except the main thread,
 				// Once this value is updated, it will start moving again.
+
+#if defined(EVAL_NNUE)
+				// Take the read lock before evaluating, as the update thread may be writing.
+				if (update_staleness)
+					continue;
+#endif
 			}
 		}
 
+#if defined(EVAL_NNUE)
+		if (idle_start)
+		{
+			idle_time += now() - idle_start;
+			idle_start = 0;
+		}
+#endif
+
 		PackedSfenValue ps;
 	RetryRead:;
 		if (!sr.read_to_thread_buffer(thread_id, ps))
@@ -2219,7 +2673,7 @@ bool LearnerThink::save(bool is_final)
 // prng: random number
 // afs: fstream of each teacher phase file
 // a_count: The number of teacher positions inherent in each file.
-void shuffle_write(const string& output_file_name , PRNG& prng , vector<fstream>& afs , vector<uint64_t>& a_count)
+void shuffle_write(const string& output_file_name , PRNG& prng , vector<SfenInputStream>& afs , vector<uint64_t>& a_count)
 {
 	uint64_t total_sfen_count = 0;
 	for (auto c : a_count)
@@ -2242,7 +2696,8 @@ void shuffle_write(const string& output_file_name , PRNG& prng , vector<fstream>
 
 	cout << endl <<  "write : " << output_file_name << endl;
 
-	fstream fs(output_file_name, ios::out | ios::binary);
+	SfenOutputStream fs;
+	fs.open(output_file_name, false, Threads.main());
 
 	// total teacher positions
 	uint64_t sum = 0;
@@ -2269,9 +2724,9 @@ void shuffle_write(const string& output_file_name , PRNG& prng , vector<fstream>
 
 		PackedSfenValue psv;
 		// It's better to read and write all at once until the performance is not so good...
-		if (afs[n].read((char*)&psv, sizeof(PackedSfenValue)))
+		if (afs[n].read(psv))
 		{
-			fs.write((char*)&psv, sizeof(PackedSfenValue));
+			fs.write(psv);
 			++write_sfen_count;
 			print_status();
 		}
@@ -2337,9 +2792,10 @@ void shuffle_files(const vector<string>& filenames , const string& output_file_n
 	// Shuffle and export as a 10M phase shredded file.
 	for (auto filename : filenames)
 	{
-		fstream fs(filename, ios::in | ios::binary);
+		SfenInputStream fs;
+		fs.open(filename, Threads.main());
 		cout << endl << "open file = " << filename;
-		while (fs.read((char*)&buf[buf_write_marker], sizeof(PackedSfenValue)))
+		while (fs.read(buf[buf_write_marker]))
 			if (++buf_write_marker == buffer_size)
 				write_buffer(buffer_size);
 
@@ -2365,9 +2821,9 @@ void shuffle_files(const vector<string>& filenames , const string& output_file_n
 	// Files are opened at the same time. It is highly possible that this will exceed FOPEN_MAX.
 	// In that case, rather than adjusting buffer_size to reduce the number of files.
 
-	vector<fstream> afs;
+	vector<SfenInputStream> afs(write_file_count);
 	for (uint64_t i = 0; i < write_file_count; ++i)
-		afs.emplace_back(fstream(make_filename(i),ios::in | ios::binary));
+		afs[i].open(make_filename(i), Threads.main());
 
 	// Throw to the subcontract function and end.
 	shuffle_write(output_file_name, prng, afs, a_count);
@@ -2391,21 +2847,15 @@ void shuffle_files_quick(const vector<string>& filenames, const string& output_f
 	vector<uint64_t> a_count(file_count);
 
 	// Count the number of teacher aspects in each file.
-	vector<fstream> afs(file_count);
+	vector<SfenInputStream> afs(file_count);
 
 	for (size_t i = 0; i <file_count ;++i)
 	{
 		auto filename = filenames[i];
 		auto& fs = afs[i];
 
-		fs.open(filename, ios::in | ios::binary);
-		fs.seekg(0, fstream::end);
-		uint64_t eofPos = (uint64_t)fs.tellg();
-		fs.clear(); // Otherwise, the next seek may fail.
-		fs.seekg(0, fstream::beg);
-		uint64_t begPos = (uint64_t)fs.tellg();
-		uint64_t file_size = eofPos - begPos;
-		uint64_t sfen_count = file_size / sizeof(PackedSfenValue);
+		fs.open(filename, Threads.main());
+		uint64_t sfen_count = fs.size();
 		a_count[i] = sfen_count;
 
 		// Output the number of sfen stored in each file.
@@ -2430,13 +2880,12 @@ void shuffle_files_on_memory(const vector<string>& filenames,const string output
 	for (auto filename : filenames)
 	{
 		std::cout << "read : " << filename << std::endl;
-		read_file_to_memory(filename, [&buf](uint64_t size) {
-			assert((size % sizeof(PackedSfenValue)) == 0);
-			// Expand the buffer and read after the last end.
-			uint64_t last = buf.size();
-			buf.resize(last + size / sizeof(PackedSfenValue));
-			return (void*)&buf[last];
-		});
+		SfenInputStream fs;
+		fs.open(filename, Threads.main());
+		buf.reserve(buf.size() + fs.size());
+		PackedSfenValue p;
+		while (fs.read(p))
+			buf.push_back(p);
 	}
 
 	// shuffle from buf[0] to buf[size-1]
@@ -2448,21 +2897,24 @@ void shuffle_files_on_memory(const vector<string>& filenames,const string output
 
 	std::cout << "write : " << output_file_name << endl;
 
-	// If the file to be written exceeds 2GB, it cannot be written in one shot with fstream::write, so use wrapper.
-	write_memory_to_file(output_file_name, (void*)&buf[0], (uint64_t)sizeof(PackedSfenValue)*(uint64_t)buf.size());
+	// If the file to be written exceeds 2GB, it cannot be written in one shot with fstream::write, so SfenOutputStream splits it.
+	SfenOutputStream fs;
+	fs.open(output_file_name, false, Threads.main());
+	fs.write(&buf[0], buf.size());
+	fs.close();
 
 	std::cout << "..shuffle_on_memory done." << std::endl;
 }
 
 void convert_bin(const vector<string>& filenames, const string& output_file_name, const int ply_minimum, const int ply_maximum, const int interpolate_eval)
 {
-	std::fstream fs;
+	SfenOutputStream fs;
 	uint64_t data_size=0;
 	uint64_t filtered_size = 0;
 	auto th = Threads.main();
 	auto &tpos = th->rootPos;
 	// convert plain rag to packed sfenvalue for Yaneura king
-	fs.open(output_file_name, ios::app | ios::binary);
+	fs.open(output_file_name, true, th);
 	StateListPtr states;
 	for (auto filename : filenames) {
 		std::cout << "convert " << filename << " ... ";
@@ -2512,7 +2964,7 @@ void convert_bin(const vector<string>& filenames, const string& output_file_name
 			}
 			else if (token == "e") {
 			  if(!ignore_flag){
-				fs.write((char*)&p, sizeof(PackedSfenValue));
+				fs.write(p);
 				data_size+=1;
 				// debug
 				// std::cout<<tpos<<std::endl;
@@ -2608,8 +3060,8 @@ void convert_bin_from_pgn_extract(const vector<string>& filenames, const string&
 	auto th = Threads.main();
 	auto &pos = th->rootPos;
 
-	std::fstream ofs;
-	ofs.open(output_file_name, ios::out | ios::binary);
+	SfenOutputStream ofs;
+	ofs.open(output_file_name, false, th);
 
 	int game_count = 0;
 	int fen_count = 0;
@@ -2740,7 +3192,7 @@ void convert_bin_from_pgn_extract(const vector<string>& filenames, const string&
 								  << std::endl;
 #endif
 
-						ofs.write((char*)&psv, sizeof(PackedSfenValue));
+						ofs.write(psv);
 						memset((char*)&psv, 0, sizeof(PackedSfenValue));
 
 						fen_count++;
@@ -2792,12 +3244,12 @@ void convert_plain(const vector<string>& filenames, const string& output_file_na
 		std::cout << "convert " << filename << " ... ";
 
 		// Just convert packedsfenvalue to text
-		std::fstream fs;
-		fs.open(filename, ios::in | ios::binary);
+		SfenInputStream fs;
+		fs.open(filename, th);
 		PackedSfenValue p;
 		while (true)
 		{
-			if (fs.read((char*)&p, sizeof(PackedSfenValue))) {
+			if (fs.read(p)) {
 				StateInfo si;
 				tpos.set_from_packed_sfen(p.sfen, &si, th, false);
 
@@ -2820,6 +3272,41 @@ void convert_plain(const vector<string>& filenames, const string& output_file_na
 	std::cout << "all done" << std::endl;
 }
 
+// Write the teacher positions of the files to output_file_name in the same order,
+// in the compressed format if it ends with kCompressedSfenExtension (or the other way round).
+// The positions written by gensfen should be compressed before they are shuffled.
+void convert_sfens(const vector<string>& filenames, const string& output_file_name)
+{
+	auto th = Threads.main();
+	SfenOutputStream ofs;
+	if (!ofs.open(output_file_name, false, th))
+	{
+		cout << "Error! : can't open " << output_file_name << endl;
+		return;
+	}
+
+	uint64_t sfen_count = 0;
+	for (auto filename : filenames) {
+		std::cout << "convert " << filename << " ... ";
+
+		SfenInputStream fs;
+		if (!fs.open(filename, th))
+		{
+			cout << "Error! : can't open " << filename << endl;
+			continue;
+		}
+		PackedSfenValue p;
+		while (fs.read(p))
+		{
+			ofs.write(p);
+			++sfen_count;
+		}
+		std::cout << "done" << std::endl;
+	}
+	ofs.close();
+	std::cout << "all done, " << sfen_count << " sfens" << std::endl;
+}
+
 void convert_from_halfkp_256x2_32_32(const std::string in_filename, const std::string out_filename, const std::string architecture, std::uint32_t version, std::uint32_t header_hash_value, std::uint32_t feature_hash_value, std::uint32_t network_hash_value, int multiply, int other_features)
 {
 	std::cout << "convert_from_halfkp_256x2_32_32 START" << std::endl;
@@ -3030,6 +3517,37 @@ void evalmerge_halfkp_256x2_32_32(const std::string in1_filename, const std::str
 	std::cout << "evalmerge_halfkp_256x2_32_32 END" << std::endl;
 }
 
+#if defined(EVAL_NNUE)
+// Convert an evaluation function file into an aligned image that can be mapped (EvalFileMmap)
+void convert_eval_image(const std::string in_filename, const std::string out_filename) {
+	std::cout << "convert_eval_image START" << std::endl;
+	std::cout << "in  : " << in_filename  << std::endl;
+	std::cout << "out : " << out_filename << std::endl;
+
+	Eval::NNUE::Initialize();
+
+	std::ifstream ifs(in_filename, std::ios::binary);
+	if (!Eval::NNUE::ReadParameters(ifs))
+	{
+		std::cout << "Error! " << in_filename << " not found or wrong format" << std::endl;
+	}
+	else
+	{
+		std::cout << "architecture : " << Eval::NNUE::GetArchitectureString() << std::endl;
+
+		std::ofstream ofs(out_filename, std::ios::binary);
+		if (!Eval::NNUE::WriteImage(ofs))
+			std::cout << "Error! " << out_filename << " could not be written" << std::endl;
+	}
+
+	// The parameters in memory no longer match the EvalFile option
+	Eval::NNUE::Initialize();
+	UCI::load_eval_finished = false;
+
+	std::cout << "convert_eval_image END" << std::endl;
+}
+#endif  // defined(EVAL_NNUE)
+
 // Learning from the generated game record
 void learn(Position&, istringstream& is)
 {
@@ -3085,6 +3603,8 @@ void learn(Position&, istringstream& is)
 	// convert teacher in pgn-extract format to Yaneura King's bin
 	bool use_convert_bin_from_pgn_extract = false;
 	bool pgn_eval_side_to_move = false;
+	// Copy teacher files to output_file_name, converting between plain and compressed (.psvz) files
+	bool use_convert_sfens = false;
 	// evalmerge options
 	int ratio_feature = 50;
 	int ratio_network = 50;
@@ -3107,6 +3627,11 @@ void learn(Position&, istringstream& is)
 	// evalmerge
 	bool use_evalmerge_halfkp_256x2_32_32 = false;
 
+#if defined(EVAL_NNUE)
+	// convert to an aligned image
+	bool use_convert_eval_image = false;
+#endif
+
 	// If the absolute value of the evaluation value in the deep search of the teacher phase exceeds this value, that phase is discarded.
 	int eval_limit = 32000;
 
@@ -3117,6 +3642,11 @@ void learn(Position&, istringstream& is)
 	// Turn on if you want to pass a pre-shuffled file.
 	bool no_shuffle = false;
 
+	// Map the teacher files and read them in a random order of blocks of mmap_block_size phases,
+	// reshuffled for every loop. This shuffles over all files without shuffle/shuffleq beforehand.
+	bool mmap_reader = false;
+	uint64_t mmap_block_size = 1024;
+
 #if defined (LOSS_FUNCTION_IS_ELMO_METHOD)
 	// elmo lambda
 	ELMO_LAMBDA = 0.33;
@@ -3140,6 +3670,9 @@ void learn(Position&, istringstream& is)
 	double newbob_decay = 1.0;
 	int newbob_num_trials = 2;
 	string nn_options;
+	// Mini-batches of examples added while the previous ones are learned (0: none)
+	int update_staleness = 0;
+	int update_threads = 0;
 #endif
 
 	uint64_t eval_save_interval = LEARN_EVAL_SAVE_INTERVAL;
@@ -3223,12 +3756,16 @@ void learn(Position&, istringstream& is)
 		else if (option == "eval_limit") is >> eval_limit;
 		else if (option == "save_only_once") save_only_once = true;
 		else if (option == "no_shuffle") no_shuffle = true;
+		else if (option == "mmap_reader") mmap_reader = true;
+		else if (option == "mmap_block_size") is >> mmap_block_size;
 
 #if defined(EVAL_NNUE)
 		else if (option == "nn_batch_size") is >> nn_batch_size;
 		else if (option == "newbob_decay") is >> newbob_decay;
 		else if (option == "newbob_num_trials") is >> newbob_num_trials;
 		else if (option == "nn_options") is >> nn_options;
+		else if (option == "update_staleness") is >> update_staleness;
+		else if (option == "update_threads") is >> update_threads;
 #endif
 		else if (option == "eval_save_interval") is >> eval_save_interval;
 		else if (option == "loss_output_interval") is >> loss_output_interval;
@@ -3237,6 +3774,7 @@ void learn(Position&, istringstream& is)
 
 		// Rabbit convert related
 		else if (option == "convert_plain") use_convert_plain = true;
+		else if (option == "convert_sfens") use_convert_sfens = true;
 		else if (option == "convert_bin") use_convert_bin = true;
 		else if (option == "interpolate_eval") is >> interpolate_eval;
 		else if (option == "convert_bin_from_pgn-extract") use_convert_bin_from_pgn_extract = true;
@@ -3262,6 +3800,11 @@ void learn(Position&, istringstream& is)
 		else if (option == "ratio_feature") is >> ratio_feature;
 		else if (option == "ratio_network") is >> ratio_network;
 
+#if defined(EVAL_NNUE)
+		// example: learn convert_eval_image nn.bin output_file_name nn.img
+		else if (option == "convert_eval_image") use_convert_eval_image = true;
+#endif
+
 		// Otherwise, it's a filename.
 		else
 			filenames.push_back(option);
@@ -3339,6 +3882,11 @@ void learn(Position&, istringstream& is)
 	cout << "base dir        : " << base_dir   << endl;
 	cout << "target dir      : " << target_dir << endl;
 
+	// A compressed file codes a position from the next one in the same game,
+	// so shuffled positions take about as much space as in a plain file.
+	if ((shuffle_normal || shuffle_quick || shuffle_on_memory) && is_compressed_sfen_file_name(output_file_name))
+		cout << "Warning! : shuffled positions hardly compress, write a plain file instead of " << output_file_name << endl;
+
 	// shuffle mode
 	if (shuffle_normal)
 	{
@@ -3359,6 +3907,12 @@ void learn(Position&, istringstream& is)
 		shuffle_files_on_memory(filenames,output_file_name);
 		return;
 	}
+	if (use_convert_sfens)
+	{
+		cout << "convert_sfens.." << endl;
+		convert_sfens(filenames, output_file_name);
+		return;
+	}
 	if (use_convert_plain)
 	{
 		init_nnue(true);
@@ -3529,14 +4083,25 @@ void learn(Position&, istringstream& is)
 		evalmerge_halfkp_256x2_32_32(filenames[0], filenames[1], output_file_name, ratio_feature, ratio_network);
 		return;
 	}
+#if defined(EVAL_NNUE)
+	if (use_convert_eval_image)
+	{
+		convert_eval_image(filenames[0], output_file_name);
+		return;
+	}
+#endif
 
 	cout << "loop              : " << loop << endl;
 	cout << "eval_limit        : " << eval_limit << endl;
 	cout << "save_only_once    : " << (save_only_once ? "true" : "false") << endl;
 	cout << "no_shuffle        : " << (no_shuffle ? "true" : "false") << endl;
+	cout << "mmap_reader       : " << (mmap_reader ? "true" : "false") << endl;
+	if (mmap_reader)
+		cout << "mmap_block_size   : " << mmap_block_size << endl;
 
 	// Insert the file name for the number of loops.
-	for (int i = 0; i < loop; ++i)
+	// The mmap reader maps each file once and makes the loops itself.
+	for (int i = 0; i < (mmap_reader ? 1 : loop); ++i)
 		// sfen reader, I'll read it in reverse order so I'll reverse it here. I'm sorry.
 		for (auto it = filenames.rbegin(); it != filenames.rend(); ++it)
 			sr.filenames.push_back(Path::Combine(base_dir, *it));
@@ -3549,6 +4114,8 @@ void learn(Position&, istringstream& is)
 #if defined(EVAL_NNUE)
 	cout << "nn_batch_size     : " << nn_batch_size     << endl;
 	cout << "nn_options        : " << nn_options        << endl;
+	cout << "update_staleness  : " << update_staleness  << endl;
+	cout << "update_threads    : " << update_threads    << endl;
 #endif
 	cout << "learning rate     : " << eta1 << " , " << eta2 << " , " << eta3 << endl;
 	cout << "eta_epoch         : " << eta1_epoch << " , " << eta2_epoch << endl;
@@ -3626,12 +4193,17 @@ void learn(Position&, istringstream& is)
 	learn_think.eval_limit = eval_limit;
 	learn_think.save_only_once = save_only_once;
 	learn_think.sr.no_shuffle = no_shuffle;
+	learn_think.sr.use_mmap = mmap_reader;
+	learn_think.sr.mmap_block_size = max(mmap_block_size, (uint64_t)1);
+	learn_think.sr.mmap_epochs = loop;
 	learn_think.freeze = freeze;
 	learn_think.reduction_gameply = reduction_gameply;
 #if defined(EVAL_NNUE)
 	learn_think.newbob_scale = 1.0;
 	learn_think.newbob_decay = newbob_decay;
 	learn_think.newbob_num_trials = newbob_num_trials;
+	learn_think.update_staleness = update_staleness;
+	learn_think.update_threads = update_threads;
 #endif
 	learn_think.eval_save_interval = eval_save_interval;
 	learn_think.loss_output_interval = loss_output_interval;
@@ -3667,7 +4239,15 @@ void learn(Position&, istringstream& is)
 	// -----------------------------------
 
 	// Start learning.
+#if defined(EVAL_NNUE)
+	learn_think.throughput_time = now();
+	if (update_staleness)
+		learn_think.start_update_worker();
+#endif
 	learn_think.go_think();
+#if defined(EVAL_NNUE)
+	learn_think.stop_update_worker();
+#endif
 
 	// Save once at the end.
 	learn_think.save(true);
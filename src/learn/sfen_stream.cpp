@@ -0,0 +1,603 @@
+﻿#if defined(EVAL_LEARN)
+
+#include "sfen_stream.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+#include "../misc.h"
+
+using namespace std;
+
+namespace Learner
+{
+	namespace {
+
+	// "PSVZ", format version
+	constexpr char kFileMagic[4] = { 'P', 'S', 'V', 'Z' };
+	constexpr uint32_t kFormatVersion = 1;
+	constexpr size_t kFileHeaderSize = 16;
+
+	// "SBLK", number of positions, size of the data
+	constexpr char kBlockMagic[4] = { 'S', 'B', 'L', 'K' };
+	constexpr size_t kBlockHeaderSize = 12;
+
+	// offset of the index, number of blocks, number of positions, "PSVZIDX"
+	constexpr char kIndexMagic[8] = { 'P', 'S', 'V', 'Z', 'I', 'D', 'X', '\0' };
+	constexpr size_t kFooterSize = 32;
+
+	// Flags at the beginning of each coded position
+	enum : uint8_t {
+		kSfenFollows   = 1 << 0, // the position of the next record after its move
+		kPlyFollows    = 1 << 1, // gamePly of the next record + 1
+		kResultFollows = 1 << 2, // -game_result of the next record
+		kPadding       = 1 << 3, // a padding byte other than 0 follows
+		kFollowFlags   = kSfenFollows | kPlyFollows | kResultFollows,
+		kAllFlags      = kFollowFlags | kPadding
+	};
+
+	// Moves made from a position before it is set again from its packed sfen.
+	// This bounds the number of StateInfo.
+	constexpr int kMaxChain = 64;
+
+	template <typename T>
+	void put(std::vector<uint8_t>& out, T value)
+	{
+		const size_t pos = out.size();
+		out.resize(pos + sizeof(T));
+		std::memcpy(&out[pos], &value, sizeof(T));
+	}
+
+	template <typename T>
+	T get(const uint8_t* p)
+	{
+		T value;
+		std::memcpy(&value, p, sizeof(T));
+		return value;
+	}
+
+	void put_varint(std::vector<uint8_t>& out, uint32_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back(uint8_t(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(uint8_t(value));
+	}
+
+	bool get_varint(const uint8_t*& p, const uint8_t* end, uint32_t& value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 35; shift += 7)
+		{
+			if (p == end)
+				return false;
+			const uint8_t b = *p++;
+			value |= uint32_t(b & 0x7f) << shift;
+			if (!(b & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	uint32_t zigzag(int32_t v) { return (uint32_t(v) << 1) ^ uint32_t(v >> 31); }
+	int32_t unzigzag(uint32_t z) { return int32_t(z >> 1) ^ -int32_t(z & 1); }
+
+	// Check the block header at offset and get the block
+	bool read_block_header(const uint8_t* data, size_t size, uint64_t offset, SfenBlockRef& block)
+	{
+		if (offset + kBlockHeaderSize > size || std::memcmp(data + offset, kBlockMagic, 4) != 0)
+			return false;
+
+		block.offset = offset + kBlockHeaderSize;
+		block.size = get<uint32_t>(data + offset + 4);
+		block.data_size = get<uint32_t>(data + offset + 8);
+
+		return block.size != 0
+			&& block.size <= kMaxSfenBlockSize
+			&& block.offset + block.data_size <= size;
+	}
+
+	} // namespace
+
+	bool is_compressed_sfen_file_name(const std::string& filename)
+	{
+		const size_t n = sizeof(kCompressedSfenExtension) - 1;
+		return filename.size() >= n
+			&& filename.compare(filename.size() - n, n, kCompressedSfenExtension) == 0;
+	}
+
+	std::string add_sfen_file_name_suffix(const std::string& filename, const std::string& suffix)
+	{
+		if (!is_compressed_sfen_file_name(filename))
+			return filename + suffix;
+
+		const size_t n = sizeof(kCompressedSfenExtension) - 1;
+		return filename.substr(0, filename.size() - n) + suffix + kCompressedSfenExtension;
+	}
+
+	bool read_sfen_block_index(const uint8_t* data, size_t size,
+		std::vector<SfenBlockRef>& blocks, uint64_t& end_of_blocks)
+	{
+		blocks.clear();
+		end_of_blocks = kFileHeaderSize;
+
+		if (size < kFileHeaderSize
+			|| std::memcmp(data, kFileMagic, 4) != 0
+			|| get<uint32_t>(data + 4) != kFormatVersion)
+			return false;
+
+		// Use the index if the footer is consistent with the file size.
+		if (size >= kFileHeaderSize + kFooterSize
+			&& std::memcmp(data + size - 8, kIndexMagic, 8) == 0)
+		{
+			const uint8_t* footer = data + size - kFooterSize;
+			const uint64_t index_offset = get<uint64_t>(footer);
+			const uint64_t block_count = get<uint64_t>(footer + 8);
+
+			bool valid = index_offset >= kFileHeaderSize
+				&& index_offset <= size - kFooterSize
+				&& (size - kFooterSize - index_offset) / 8 == block_count
+				&& (size - kFooterSize - index_offset) % 8 == 0;
+
+			uint64_t end = kFileHeaderSize;
+			for (uint64_t i = 0; valid && i < block_count; ++i)
+			{
+				SfenBlockRef block;
+				const uint64_t offset = get<uint64_t>(data + index_offset + i * 8);
+				valid = offset == end
+					&& read_block_header(data, index_offset, offset, block);
+				if (valid)
+				{
+					blocks.push_back(block);
+					end = block.offset + block.data_size;
+				}
+			}
+
+			if (valid && end == index_offset)
+			{
+				end_of_blocks = end;
+				return true;
+			}
+
+			blocks.clear();
+		}
+
+		// Otherwise (e.g. gensfen was interrupted) follow the blocks from the beginning.
+		SfenBlockRef block;
+		while (read_block_header(data, size, end_of_blocks, block))
+		{
+			blocks.push_back(block);
+			end_of_blocks = block.offset + block.data_size;
+		}
+
+		return true;
+	}
+
+	// -----------------------------------
+	//   SfenBlockCodec
+	// -----------------------------------
+
+	// Position of the last coded record, from which the position of the previous record is predicted.
+	// The encoder and the decoder call set() and advance() for the same records, so they stay in sync.
+	struct SfenBlockCodec::Predictor
+	{
+		Position pos;
+		StateInfo states[kMaxChain + 1];
+		PackedSfen current;
+		int chain = 0;
+		bool valid = false;
+		Thread* th;
+
+		void set(const PackedSfen& sfen)
+		{
+			current = sfen;
+			chain = 0;
+			valid = pos.set_from_packed_sfen(sfen, &states[0], th) == 0;
+		}
+
+		// Get the packed sfen after the move. Returns false if the move cannot be made.
+		// The encoder only lets a legal move follow. The decoder replays those moves,
+		// so it skips legal() and only rejects what would break the position when the
+		// data is broken: a move that is not pseudo legal or that captures a king.
+		bool advance(uint16_t move, PackedSfen& sfen, bool check_legal)
+		{
+			if (chain == kMaxChain)
+				set(current);
+
+			const Move m = Move(move);
+			if (!valid || !is_ok(m) || !pos.pseudo_legal(m))
+				return false;
+
+			if (check_legal ? !pos.legal(m) : type_of(pos.piece_on(to_sq(m))) == KING)
+				return false;
+
+			pos.do_move(m, states[++chain]);
+			pos.sfen_pack(current);
+			sfen = current;
+			return true;
+		}
+	};
+
+	SfenBlockCodec::SfenBlockCodec(Thread* th) : predictor(new Predictor)
+	{
+		predictor->th = th;
+	}
+
+	SfenBlockCodec::~SfenBlockCodec() = default;
+
+	// The positions are coded from the last one, each relative to the record after it.
+	void SfenBlockCodec::encode(const PackedSfenValue* sfens, size_t size, SfenBlock& block)
+	{
+		assert(size <= kMaxSfenBlockSize);
+
+		auto& out = block.data;
+		out.clear();
+		block.size = uint32_t(size);
+
+		for (size_t i = size; i-- > 0; )
+		{
+			const PackedSfenValue& psv = sfens[i];
+			const PackedSfenValue* next = i + 1 < size ? &sfens[i + 1] : nullptr;
+
+			uint8_t flags = 0;
+			PackedSfen predicted;
+			if (next
+				&& predictor->advance(next->move, predicted, true)
+				&& std::memcmp(&predicted, &psv.sfen, sizeof(PackedSfen)) == 0)
+				flags |= kSfenFollows;
+			else
+				predictor->set(psv.sfen);
+
+			if (next && psv.gamePly == uint16_t(next->gamePly + 1))
+				flags |= kPlyFollows;
+			if (next && psv.game_result == -next->game_result)
+				flags |= kResultFollows;
+			if (psv.padding)
+				flags |= kPadding;
+
+			out.push_back(flags);
+			if (!(flags & kSfenFollows))
+				out.insert(out.end(), psv.sfen.data, psv.sfen.data + sizeof(PackedSfen));
+			if (!(flags & kPlyFollows))
+				put_varint(out, psv.gamePly);
+			if (!(flags & kResultFollows))
+				out.push_back(uint8_t(psv.game_result));
+
+			// The scores of consecutive positions are seen from the opposite sides.
+			put_varint(out, zigzag(psv.score + (next ? next->score : 0)));
+			put(out, psv.move);
+			if (flags & kPadding)
+				out.push_back(psv.padding);
+		}
+	}
+
+	bool SfenBlockCodec::decode(const uint8_t* data, size_t data_size, size_t size, PSVector& sfens)
+	{
+		const size_t base = sfens.size();
+		sfens.resize(base + size);
+
+		const uint8_t* p = data;
+		const uint8_t* end = data + data_size;
+
+		for (size_t i = size; i-- > 0; )
+		{
+			PackedSfenValue& psv = sfens[base + i];
+			const PackedSfenValue* next = i + 1 < size ? &sfens[base + i + 1] : nullptr;
+
+			if (p == end)
+				goto Broken;
+
+			const uint8_t flags = *p++;
+			if ((flags & ~kAllFlags) || (!next && (flags & kFollowFlags)))
+				goto Broken;
+
+			if (flags & kSfenFollows)
+			{
+				if (!predictor->advance(next->move, psv.sfen, false))
+					goto Broken;
+			}
+			else
+			{
+				if (end - p < (ptrdiff_t)sizeof(PackedSfen))
+					goto Broken;
+				std::memcpy(&psv.sfen, p, sizeof(PackedSfen));
+				p += sizeof(PackedSfen);
+				predictor->set(psv.sfen);
+			}
+
+			uint32_t value;
+			if (flags & kPlyFollows)
+				psv.gamePly = uint16_t(next->gamePly + 1);
+			else
+			{
+				if (!get_varint(p, end, value))
+					goto Broken;
+				psv.gamePly = uint16_t(value);
+			}
+
+			if (flags & kResultFollows)
+				psv.game_result = int8_t(-next->game_result);
+			else
+			{
+				if (p == end)
+					goto Broken;
+				psv.game_result = int8_t(*p++);
+			}
+
+			if (!get_varint(p, end, value))
+				goto Broken;
+			psv.score = int16_t(unzigzag(value) - (next ? next->score : 0));
+
+			if (end - p < 2)
+				goto Broken;
+			psv.move = get<uint16_t>(p);
+			p += 2;
+
+			psv.padding = 0;
+			if (flags & kPadding)
+			{
+				if (p == end)
+					goto Broken;
+				psv.padding = *p++;
+			}
+		}
+
+		if (p == end)
+			return true;
+
+	Broken:;
+		sfens.resize(base);
+		return false;
+	}
+
+	// -----------------------------------
+	//   SfenInputStream
+	// -----------------------------------
+
+	bool SfenInputStream::open(const std::string& filename, Thread* th)
+	{
+		close();
+
+		fs.open(filename, ios::in | ios::binary);
+		if (!fs)
+			return false;
+
+		char magic[4];
+		const bool compressed = fs.read(magic, 4) && std::memcmp(magic, kFileMagic, 4) == 0;
+		fs.clear();
+
+		if (!compressed)
+		{
+			fs.seekg(0, ios::end);
+			sfen_count = uint64_t(fs.tellg()) / sizeof(PackedSfenValue);
+			fs.seekg(0, ios::beg);
+			return true;
+		}
+
+		fs.close();
+
+		uint64_t end_of_blocks;
+		mapped_addr = map_file(filename, mapped_size);
+		if (!mapped_addr
+			|| !read_sfen_block_index((const uint8_t*)mapped_addr, mapped_size, blocks, end_of_blocks))
+		{
+			cout << "Error! : can't read " << filename << endl;
+			close();
+			return false;
+		}
+
+		for (const auto& block : blocks)
+			sfen_count += block.size;
+
+		codec.reset(new SfenBlockCodec(th));
+		return true;
+	}
+
+	void SfenInputStream::close()
+	{
+		if (fs.is_open())
+			fs.close();
+
+		unmap_file(mapped_addr, mapped_size);
+		mapped_addr = nullptr;
+		mapped_size = 0;
+		blocks.clear();
+		next_block = 0;
+		decoded.clear();
+		next_sfen = 0;
+		codec.reset();
+		sfen_count = 0;
+	}
+
+	bool SfenInputStream::read(PackedSfenValue& psv)
+	{
+		if (!mapped_addr)
+			return bool(fs.read((char*)&psv, sizeof(PackedSfenValue)));
+
+		while (next_sfen == decoded.size())
+		{
+			if (next_block == blocks.size())
+				return false;
+
+			const auto& block = blocks[next_block++];
+			decoded.clear();
+			next_sfen = 0;
+			if (!codec->decode((const uint8_t*)mapped_addr + block.offset, block.data_size, block.size, decoded))
+			{
+				cout << "Error! : broken block at offset " << block.offset << endl;
+				next_block = blocks.size();
+				return false;
+			}
+		}
+
+		psv = decoded[next_sfen++];
+		return true;
+	}
+
+	// -----------------------------------
+	//   SfenOutputStream
+	// -----------------------------------
+
+	bool SfenOutputStream::open(const std::string& filename, bool append, Thread* th)
+	{
+		close();
+
+		compressed = is_compressed_sfen_file_name(filename);
+		if (!compressed)
+		{
+			fs.open(filename, ios::out | ios::binary | (append ? ios::app : ios::trunc));
+			return fs.is_open();
+		}
+
+		codec.reset(new SfenBlockCodec(th));
+		pending.clear();
+		block_offsets.clear();
+		sfen_count = 0;
+		index_written = false;
+
+		size_t size = 0;
+		void* addr = append ? map_file(filename, size) : nullptr;
+		if (addr)
+		{
+			// Continue after the last block of the existing file.
+			// The index is written again after the new blocks.
+			std::vector<SfenBlockRef> blocks;
+			const bool valid = read_sfen_block_index((const uint8_t*)addr, size, blocks, end_of_blocks);
+			unmap_file(addr, size);
+			if (!valid)
+			{
+				cout << "Error! : " << filename << " is not a compressed sfen file." << endl;
+				return false;
+			}
+
+			for (const auto& block : blocks)
+			{
+				block_offsets.push_back(block.offset - kBlockHeaderSize);
+				sfen_count += block.size;
+			}
+
+			fs.open(filename, ios::in | ios::out | ios::binary);
+			index_written = true;
+			return fs.is_open();
+		}
+
+		fs.open(filename, ios::out | ios::binary | ios::trunc);
+		std::vector<uint8_t> header;
+		header.insert(header.end(), kFileMagic, kFileMagic + 4);
+		put(header, kFormatVersion);
+		header.resize(kFileHeaderSize);
+		fs.write((const char*)header.data(), header.size());
+		end_of_blocks = kFileHeaderSize;
+
+		return fs.is_open();
+	}
+
+	void SfenOutputStream::close()
+	{
+		if (fs.is_open())
+		{
+			if (compressed)
+			{
+				write_pending_block();
+				write_index();
+			}
+			fs.close();
+		}
+
+		codec.reset();
+		pending.clear();
+		block_offsets.clear();
+	}
+
+	void SfenOutputStream::write(const PackedSfenValue* sfens, size_t size)
+	{
+		if (!compressed)
+		{
+			// fstream::write() can not write 2GB or more at once.
+			const size_t kChunkSize = 1024 * 1024;
+			for (size_t i = 0; i < size; i += kChunkSize)
+				fs.write((const char*)(sfens + i), sizeof(PackedSfenValue) * std::min(kChunkSize, size - i));
+			return;
+		}
+
+		while (size)
+		{
+			const size_t n = std::min(size, kSfenBlockSize - pending.size());
+			pending.insert(pending.end(), sfens, sfens + n);
+			sfens += n;
+			size -= n;
+
+			if (pending.size() == kSfenBlockSize)
+				write_pending_block();
+		}
+	}
+
+	void SfenOutputStream::write(const SfenBlock& block)
+	{
+		assert(compressed);
+
+		// Keep the order of the positions written so far.
+		write_pending_block();
+
+		if (index_written)
+		{
+			fs.seekp(end_of_blocks);
+			index_written = false;
+		}
+
+		std::vector<uint8_t> header;
+		header.insert(header.end(), kBlockMagic, kBlockMagic + 4);
+		put(header, block.size);
+		put(header, uint32_t(block.data.size()));
+		fs.write((const char*)header.data(), header.size());
+		fs.write((const char*)block.data.data(), block.data.size());
+
+		block_offsets.push_back(end_of_blocks);
+		end_of_blocks += kBlockHeaderSize + block.data.size();
+		sfen_count += block.size;
+	}
+
+	void SfenOutputStream::flush()
+	{
+		if (compressed)
+		{
+			write_pending_block();
+			write_index();
+		}
+		fs.flush();
+	}
+
+	void SfenOutputStream::write_pending_block()
+	{
+		if (pending.empty())
+			return;
+
+		codec->encode(pending.data(), pending.size(), block_buffer);
+		pending.clear();
+		write(block_buffer);
+	}
+
+	void SfenOutputStream::write_index()
+	{
+		if (index_written)
+			return;
+
+		std::vector<uint8_t> index;
+		for (auto offset : block_offsets)
+			put(index, offset);
+		put(index, end_of_blocks);
+		put(index, uint64_t(block_offsets.size()));
+		put(index, sfen_count);
+		index.insert(index.end(), kIndexMagic, kIndexMagic + 8);
+
+		fs.seekp(end_of_blocks);
+		fs.write((const char*)index.data(), index.size());
+		index_written = true;
+	}
+}
+
+#endif // defined(EVAL_LEARN)
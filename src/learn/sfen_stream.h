@@ -0,0 +1,181 @@
+﻿#ifndef _SFEN_STREAM_H_
+#define _SFEN_STREAM_H_
+
+#if defined(EVAL_LEARN)
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "learn.h"
+
+// Reading and writing of teacher position files.
+//
+// Besides the plain .bin files (an array of PackedSfenValue), a block compressed
+// container is supported. Its files end with kCompressedSfenExtension and consist of
+//   a file header,
+//   blocks of at most kMaxSfenBlockSize positions, each compressed on its own,
+//   an index of the block offsets and a footer.
+// Any block can be located with the index and decoded by itself, e.g. to read the
+// blocks in a random order. The index is rewritten by flush() and close(), and a file
+// without a valid index (an interrupted gensfen) is still read by scanning the blocks.
+//
+// gensfen writes the positions of a game backwards from the end, so the position of a
+// record is usually the position of the next record after its move. Such a position
+// is stored as a flag instead of 32 bytes, and gamePly, game_result and score are coded
+// relative to the next record too. This only holds in the order gensfen writes, so
+// shuffled files hardly get smaller.
+
+namespace Learner
+{
+	// Extension of the files written in the compressed format
+	constexpr char kCompressedSfenExtension[] = ".psvz";
+
+	// Number of positions in a block written by SfenOutputStream
+	constexpr size_t kSfenBlockSize = 4096;
+
+	// Upper limit of the number of positions in a block
+	constexpr size_t kMaxSfenBlockSize = 65536;
+
+	// Whether filename is written in the compressed format
+	bool is_compressed_sfen_file_name(const std::string& filename);
+
+	// Append suffix to filename, before kCompressedSfenExtension if it has the extension
+	std::string add_sfen_file_name_suffix(const std::string& filename, const std::string& suffix);
+
+	// A compressed block
+	struct SfenBlock
+	{
+		// number of positions
+		uint32_t size = 0;
+
+		std::vector<uint8_t> data;
+	};
+
+	// Location of a block in a compressed file
+	struct SfenBlockRef
+	{
+		// offset of the compressed data from the beginning of the file
+		uint64_t offset;
+
+		// number of positions
+		uint32_t size;
+
+		// size of the compressed data in bytes
+		uint32_t data_size;
+	};
+
+	// Get the blocks of a compressed file in memory. Returns false if it is not a compressed file.
+	// end_of_blocks is set to the offset just after the last valid block.
+	bool read_sfen_block_index(const uint8_t* data, size_t size,
+		std::vector<SfenBlockRef>& blocks, uint64_t& end_of_blocks);
+
+	// Compress and decompress blocks.
+	// The positions used for the prediction make moves on the given thread
+	// (only its node counter is touched).
+	class SfenBlockCodec
+	{
+	public:
+		explicit SfenBlockCodec(Thread* th);
+		~SfenBlockCodec();
+
+		SfenBlockCodec(const SfenBlockCodec&) = delete;
+		SfenBlockCodec& operator=(const SfenBlockCodec&) = delete;
+
+		void encode(const PackedSfenValue* sfens, size_t size, SfenBlock& block);
+
+		// Append the positions of a block to sfens. Returns false if the data is broken.
+		bool decode(const uint8_t* data, size_t data_size, size_t size, PSVector& sfens);
+
+	private:
+		struct Predictor;
+		std::unique_ptr<Predictor> predictor;
+	};
+
+	// Sequential reader of a plain or compressed teacher file.
+	// The format is determined from the contents of the file.
+	class SfenInputStream
+	{
+	public:
+		SfenInputStream() = default;
+		~SfenInputStream() { close(); }
+
+		SfenInputStream(const SfenInputStream&) = delete;
+		SfenInputStream& operator=(const SfenInputStream&) = delete;
+
+		bool open(const std::string& filename, Thread* th);
+		void close();
+
+		bool read(PackedSfenValue& psv);
+
+		// Number of positions in the file
+		uint64_t size() const { return sfen_count; }
+
+		bool is_compressed() const { return mapped_addr != nullptr; }
+
+	private:
+		// plain format
+		std::ifstream fs;
+
+		// compressed format
+		void* mapped_addr = nullptr;
+		size_t mapped_size = 0;
+		std::vector<SfenBlockRef> blocks;
+		size_t next_block = 0;
+		PSVector decoded;
+		size_t next_sfen = 0;
+		std::unique_ptr<SfenBlockCodec> codec;
+
+		uint64_t sfen_count = 0;
+	};
+
+	// Writer of a plain or compressed teacher file.
+	class SfenOutputStream
+	{
+	public:
+		SfenOutputStream() = default;
+		~SfenOutputStream() { close(); }
+
+		SfenOutputStream(const SfenOutputStream&) = delete;
+		SfenOutputStream& operator=(const SfenOutputStream&) = delete;
+
+		// Open filename, in the compressed format if is_compressed_sfen_file_name(filename).
+		// With append, the positions are added to those already in the file.
+		bool open(const std::string& filename, bool append, Thread* th);
+		void close();
+
+		bool is_open() const { return fs.is_open(); }
+		bool is_compressed() const { return compressed; }
+
+		void write(const PackedSfenValue* sfens, size_t size);
+		void write(const PackedSfenValue& psv) { write(&psv, 1); }
+
+		// Append a block encoded by the caller (compressed format only)
+		void write(const SfenBlock& block);
+
+		// Write out the buffered positions (and the index) so that the file can be read as it is.
+		void flush();
+
+	private:
+		void write_pending_block();
+		void write_index();
+
+		std::fstream fs;
+		bool compressed = false;
+
+		// compressed format
+		std::unique_ptr<SfenBlockCodec> codec;
+		PSVector pending;
+		SfenBlock block_buffer;
+		std::vector<uint64_t> block_offsets;
+		uint64_t sfen_count = 0;
+		uint64_t end_of_blocks = 0;
+		bool index_written = false;
+	};
+}
+
+#endif // defined(EVAL_LEARN)
+
+#endif // #ifndef _SFEN_STREAM_H_
@@ -49,8 +49,15 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 #include <vector>
 
 #if defined(__linux__) && !defined(__ANDROID__)
+#include <sched.h>
 #include <stdlib.h>
+#endif
+
+#if !defined(_WIN32)
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 #include "misc.h"
@@ -295,6 +302,16 @@ void prefetch(void* addr) {
 #endif
 
 
+/// use_large_pages() sets whether the allocations below ask for large pages
+/// (UCI option LargePages). It takes effect for the memory allocated afterwards.
+
+namespace {
+  bool largePages = true;
+}
+
+void use_large_pages(bool enabled) { largePages = enabled; }
+
+
 /// aligned_ttmem_alloc() will return suitably aligned memory, and if possible use large pages.
 /// The returned pointer is the aligned one, while the mem argument is the one that needs
 /// to be passed to free. With c++17 some of this functionality could be simplified.
@@ -307,7 +324,7 @@ void* aligned_ttmem_alloc(size_t allocSize, void*& mem) {
   size_t size = ((allocSize + alignment - 1) / alignment) * alignment; // multiple of alignment
   if (posix_memalign(&mem, alignment, size))
      mem = nullptr;
-  madvise(mem, allocSize, MADV_HUGEPAGE);
+  madvise(mem, allocSize, largePages ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
   return mem;
 }
 
@@ -363,7 +380,7 @@ void* aligned_ttmem_alloc(size_t allocSize, void*& mem) {
   static bool firstCall = true;
 
   // Try to allocate large pages
-  mem = aligned_ttmem_alloc_large_pages(allocSize);
+  mem = largePages ? aligned_ttmem_alloc_large_pages(allocSize) : nullptr;
 
   // Suppress info strings on the first call. The first call occurs before 'uci'
   // is received and in that case this output confuses some GUIs.
@@ -421,81 +438,242 @@ void aligned_ttmem_free(void *mem) {
 #endif
 
 
-namespace WinProcGroup {
+/// aligned_large_pages_alloc() allocates memory aligned to a cache line at least
+/// in large pages like the transposition table, for the other data that is
+/// accessed at random (NNUE parameters, thread data). Unlike aligned_ttmem_alloc()
+/// it does not report the Windows large pages. Smaller blocks than a large page
+/// are allocated normally. Returns nullptr on failure.
 
-#ifndef _WIN32
+void* aligned_large_pages_alloc(size_t size) {
 
-void bindThisThread(size_t) {}
+#if defined(__linux__) && !defined(__ANDROID__)
+  if (size >= 2 * 1024 * 1024)
+  {
+      void* mem;
+      return aligned_ttmem_alloc(size, mem);
+  }
+#elif defined(_WIN64)
+  if (size >= 2 * 1024 * 1024)
+  {
+      void* mem = largePages ? aligned_ttmem_alloc_large_pages(size) : nullptr;
+      return mem ? mem : VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  }
+#endif
 
-#else
+  return _mm_malloc(size, 64);
+}
 
-/// best_group() retrieves logical processor information using Windows specific
-/// API and returns the best group id for the thread with index idx. Original
-/// code from Texel by Peter Österlund.
+void aligned_large_pages_free(void* ptr, size_t size) {
 
-int best_group(size_t idx) {
+#if (defined(__linux__) && !defined(__ANDROID__)) || defined(_WIN64)
+  if (size >= 2 * 1024 * 1024)
+  {
+      aligned_ttmem_free(ptr);
+      return;
+  }
+#endif
 
-  int threads = 0;
-  int nodes = 0;
-  int cores = 0;
-  DWORD returnLength = 0;
-  DWORD byteOffset = 0;
+  _mm_free(ptr);
+}
 
-  // Early exit if the needed API is not available at runtime
-  HMODULE k32 = GetModuleHandle("Kernel32.dll");
-  auto fun1 = (fun1_t)(void(*)())GetProcAddress(k32, "GetLogicalProcessorInformationEx");
-  if (!fun1)
-      return -1;
 
-  // First call to get returnLength. We expect it to fail due to null buffer
-  if (fun1(RelationAll, nullptr, &returnLength))
-      return -1;
+/// map_file() maps a whole file read-only into memory. The pages are backed by
+/// the page cache, so processes mapping the same file share them. Returns
+/// nullptr on failure, otherwise the page aligned address and the file size.
+
+#if defined(_WIN32)
 
-  // Once we know returnLength, allocate the buffer
-  SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *buffer, *ptr;
-  ptr = buffer = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*)malloc(returnLength);
+void* map_file(const std::string& fname, size_t& size) {
 
-  // Second call, now we expect to succeed
-  if (!fun1(RelationAll, buffer, &returnLength))
+  HANDLE file = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+      return nullptr;
+
+  LARGE_INTEGER fileSize;
+  HANDLE mapping = nullptr;
+  void* addr = nullptr;
+  if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+      mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping)
   {
-      free(buffer);
-      return -1;
+      addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(mapping); // The view keeps the mapping alive
   }
+  CloseHandle(file);
 
-  while (byteOffset < returnLength)
-  {
-      if (ptr->Relationship == RelationNumaNode)
-          nodes++;
+  size = addr ? size_t(fileSize.QuadPart) : 0;
+  return addr;
+}
 
-      else if (ptr->Relationship == RelationProcessorCore)
-      {
-          cores++;
-          threads += (ptr->Processor.Flags == LTP_PC_SMT) ? 2 : 1;
-      }
+void unmap_file(void* addr, size_t /*size*/) {
+
+  if (addr)
+      UnmapViewOfFile(addr);
+}
 
-      assert(ptr->Size);
-      byteOffset += ptr->Size;
-      ptr = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*)(((char*)ptr) + ptr->Size);
+#else
+
+void* map_file(const std::string& fname, size_t& size) {
+
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd == -1)
+      return nullptr;
+
+  struct stat st;
+  void* addr = nullptr;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+  {
+      addr = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+      if (addr == MAP_FAILED)
+          addr = nullptr;
   }
+  close(fd); // The mapping stays valid after the descriptor is closed
 
-  free(buffer);
+  size = addr ? size_t(st.st_size) : 0;
+  return addr;
+}
+
+void unmap_file(void* addr, size_t size) {
+
+  if (addr)
+      munmap(addr, size);
+}
+
+#endif
+
+
+namespace {
+
+#if (defined(__linux__) && !defined(__ANDROID__)) || defined(_WIN32)
+
+/// assign_threads() returns the node of each thread index given the physical
+/// cores of each node and the number of logical processors beyond them. Run as
+/// many threads as possible on the same node until its core limit is reached,
+/// then move on filling the next node. The threads on the remaining logical
+/// processors are spread evenly across the nodes, and the OS decides for the
+/// threads beyond them. Original code from Texel by Peter sterlund.
+
+std::vector<int> assign_threads(const std::vector<int>& cores, int smt) {
 
   std::vector<int> groups;
 
-  // Run as many threads as possible on the same node until core limit is
-  // reached, then move on filling the next node.
-  for (int n = 0; n < nodes; n++)
-      for (int i = 0; i < cores / nodes; i++)
+  for (int n = 0; n < int(cores.size()); n++)
+      for (int i = 0; i < cores[n]; i++)
           groups.push_back(n);
 
-  // In case a core has more than one logical processor (we assume 2) and we
-  // have still threads to allocate, then spread them evenly across available
-  // nodes.
-  for (int t = 0; t < threads - cores; t++)
-      groups.push_back(t % nodes);
+  for (int t = 0; t < smt && !cores.empty(); t++)
+      groups.push_back(t % int(cores.size()));
+
+  return groups;
+}
+
+#endif
+
+#if defined(_WIN32)
+
+/// NumaNode is a NUMA node with at least one logical processor. The nodes
+/// are indexed by their position in numa_nodes(), not by their node number,
+/// which can have gaps.
+
+struct NumaNode {
+  GROUP_AFFINITY affinity; // processors of the node in its primary group
+  int cores;               // physical cores
+  int smt;                 // logical processors beyond the physical cores
+};
+
+/// numa_nodes() queries the nodes and counts their processors once
+
+const std::vector<NumaNode>& numa_nodes() {
+
+  static const std::vector<NumaNode> nodes = [] {
+      std::vector<NumaNode> result;
+
+      // Early exit if the needed API are not available at runtime
+      HMODULE k32 = GetModuleHandle("Kernel32.dll");
+      auto fun1 = (fun1_t)(void(*)())GetProcAddress(k32, "GetLogicalProcessorInformationEx");
+      auto fun2 = (fun2_t)(void(*)())GetProcAddress(k32, "GetNumaNodeProcessorMaskEx");
+      ULONG highest;
+
+      if (!fun1 || !fun2 || !GetNumaHighestNodeNumber(&highest))
+          return result;
+
+      for (ULONG n = 0; n <= highest; n++)
+      {
+          GROUP_AFFINITY affinity;
+          if (fun2(USHORT(n), &affinity) && affinity.Mask)
+              result.push_back({affinity, 0, 0});
+      }
+
+      // First call to get returnLength. We expect it to fail due to null buffer
+      DWORD returnLength = 0;
+      if (fun1(RelationProcessorCore, nullptr, &returnLength))
+          return result;
+
+      std::vector<char> buffer(returnLength);
+      if (!fun1(RelationProcessorCore, (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*)buffer.data(), &returnLength))
+          return result;
+
+      // Give each core to the node whose processors it shares
+      for (DWORD byteOffset = 0; byteOffset < returnLength; )
+      {
+          auto ptr = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*)(buffer.data() + byteOffset);
+          const GROUP_AFFINITY& core = ptr->Processor.GroupMask[0];
+
+          for (auto& node : result)
+              if (node.affinity.Group == core.Group && (node.affinity.Mask & core.Mask))
+              {
+                  node.cores++;
+                  node.smt += (ptr->Processor.Flags == LTP_PC_SMT) ? 1 : 0;
+                  break;
+              }
+
+          assert(ptr->Size);
+          byteOffset += ptr->Size;
+      }
+      return result;
+  }();
+  return nodes;
+}
+
+/// thread_nodes() returns the node of each thread index, computed once
+
+const std::vector<int>& thread_nodes() {
+
+  static const std::vector<int> groups = [] {
+      std::vector<int> cores;
+      int smt = 0;
+      for (const auto& node : numa_nodes())
+      {
+          cores.push_back(node.cores);
+          smt += node.smt;
+      }
+
+      return assign_threads(cores, smt);
+  }();
+  return groups;
+}
+
+#endif
+
+} // namespace
+
+
+namespace WinProcGroup {
+
+#ifndef _WIN32
 
-  // If we still have more threads than the total number of logical processors
-  // then return -1 and let the OS to decide what to do.
+void bindThisThread(size_t) {}
+
+#else
+
+/// best_group() returns the index in numa_nodes() of the node for the thread
+/// with index idx, or -1 if the OS should decide. Numa::best_node() is the same
+/// assignment, so that a thread is bound to the same node by both.
+
+int best_group(size_t idx) {
+
+  const auto& groups = thread_nodes();
   return idx < groups.size() ? groups[idx] : -1;
 }
 
@@ -504,28 +682,147 @@ int best_group(size_t idx) {
 
 void bindThisThread(size_t idx) {
 
-  // Use only local variables to be thread-safe
-  int group = best_group(idx);
+  Numa::bind_this_thread(best_group(idx));
+}
+
+#endif
+
+} // namespace WinProcGroup
+
+
+namespace Numa {
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+namespace {
+
+/// parse_list() reads a list of numbers like "0-3,8-11" as found in sysfs
 
-  if (group == -1)
+std::vector<int> parse_list(const std::string& fname) {
+
+  std::vector<int> list;
+  std::ifstream file(fname);
+  std::string range;
+
+  while (std::getline(file, range, ','))
+  {
+      int first, last;
+      char dash;
+      std::istringstream ss(range);
+      if (!(ss >> first))
+          continue;
+
+      last = (ss >> dash >> last) ? last : first;
+      for (int i = first; i <= last; ++i)
+          list.push_back(i);
+  }
+  return list;
+}
+
+/// node_cpus() returns the logical processors of each online node, read once
+
+const std::vector<std::vector<int>>& node_cpus() {
+
+  static const std::vector<std::vector<int>> nodes = [] {
+      std::vector<std::vector<int>> result;
+      for (int n : parse_list("/sys/devices/system/node/online"))
+          result.push_back(parse_list("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist"));
+      return result;
+  }();
+  return nodes;
+}
+
+/// thread_nodes() returns the node of each thread index, computed once
+
+const std::vector<int>& thread_nodes() {
+
+  static const std::vector<int> groups = [] {
+      const auto& nodes = node_cpus();
+      std::vector<int> cores(nodes.size());
+      int smt = 0;
+
+      for (size_t n = 0; n < nodes.size(); n++)
+          for (int cpu : nodes[n])
+          {
+              // The first logical processor of a core stands for the core
+              auto siblings = parse_list("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list");
+              if (siblings.empty() || siblings[0] == cpu)
+                  cores[n]++;
+              else
+                  smt++;
+          }
+
+      return assign_threads(cores, smt);
+  }();
+  return groups;
+}
+
+} // namespace
+
+int node_count() { return std::max(int(node_cpus().size()), 1); }
+
+int best_node(size_t idx) {
+
+  const auto& groups = thread_nodes();
+  return idx < groups.size() ? groups[idx] : -1;
+}
+
+void bind_this_thread(int node) {
+
+  if (node < 0 || node >= int(node_cpus().size()))
+      return;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : node_cpus()[node])
+      if (cpu < CPU_SETSIZE)
+          CPU_SET(cpu, &set);
+
+  sched_setaffinity(0, sizeof(set), &set);
+}
+
+#elif defined(_WIN32)
+
+int node_count() { return std::max(int(numa_nodes().size()), 1); }
+
+int best_node(size_t idx) { return WinProcGroup::best_group(idx); }
+
+void bind_this_thread(int node) {
+
+  if (node < 0 || node >= int(numa_nodes().size()))
       return;
 
-  // Early exit if the needed API are not available at runtime
   HMODULE k32 = GetModuleHandle("Kernel32.dll");
-  auto fun2 = (fun2_t)(void(*)())GetProcAddress(k32, "GetNumaNodeProcessorMaskEx");
   auto fun3 = (fun3_t)(void(*)())GetProcAddress(k32, "SetThreadGroupAffinity");
 
-  if (!fun2 || !fun3)
+  if (!fun3)
       return;
 
-  GROUP_AFFINITY affinity;
-  if (fun2(group, &affinity))
-      fun3(GetCurrentThread(), &affinity, nullptr);
+  GROUP_AFFINITY affinity = numa_nodes()[node].affinity;
+  fun3(GetCurrentThread(), &affinity, nullptr);
 }
 
+#else
+
+int node_count() { return 1; }
+int best_node(size_t) { return -1; }
+void bind_this_thread(int) {}
+
 #endif
 
-} // namespace WinProcGroup
+/// run_on_node() calls f on a thread bound to the node, so that the pages f
+/// touches first are allocated on the node by the OS.
+
+void run_on_node(int node, const std::function<void()>& f) {
+
+  std::thread th([&] {
+      bind_this_thread(node);
+      f();
+  });
+  th.join();
+}
+
+} // namespace Numa
 
 // Returns a string that represents the current time. (Used when learning evaluation functions)
 std::string now_string()
@@ -42,6 +42,11 @@ void prefetch(void* addr);
 void start_logger(const std::string& fname);
 void* aligned_ttmem_alloc(size_t size, void*& mem);
 void aligned_ttmem_free(void* mem); // nop if mem == nullptr
+void* aligned_large_pages_alloc(size_t size); // large pages if size allows, nullptr on failure
+void aligned_large_pages_free(void* ptr, size_t size); // size as passed to alloc, nop if ptr == nullptr
+void use_large_pages(bool enabled);
+void* map_file(const std::string& fname, size_t& size); // read-only, shared between processes
+void unmap_file(void* addr, size_t size); // nop if addr == nullptr
 
 void dbg_hit_on(bool b);
 void dbg_hit_on(bool c, bool b);
@@ -152,6 +157,17 @@ inline uint64_t mul_hi64(uint64_t a, uint64_t b) {
 namespace WinProcGroup {
   void bindThisThread(size_t idx);
 }
+
+/// Numa gives the NUMA nodes of the machine to the code keeping a copy of its
+/// data on each node (EvalNumaReplication, EvalHashPerNode). Under Windows the
+/// nodes and the node of each thread are those of WinProcGroup::bindThisThread().
+
+namespace Numa {
+  int node_count();                // 1 when the nodes can not be queried
+  int best_node(size_t idx);       // -1 if the OS should decide
+  void bind_this_thread(int node);
+  void run_on_node(int node, const std::function<void()>& f); // memory first touched by f is allocated on node
+}
 // sleep for the specified number of milliseconds.
 extern void sleep(int ms);
 
@@ -282,7 +298,7 @@ public:
   template <typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
 
   T* allocate(std::size_t n) { return (T*)aligned_malloc(n * sizeof(T), alignof(T)); }
-  void deallocate(T* p, std::size_t n) { aligned_free(p); }
+  void deallocate(T* p, std::size_t /*n*/) { aligned_free(p); }
 };
 
 // --------------------
@@ -350,21 +350,19 @@ void Position::set_check_info(StateInfo* si) const {
 }
 
 
-template<PieceType Pt, Color Us>
-Bitboard pieceMobility(const Position& pos) {
-  Bitboard b;
-  if (Pt == PAWN) {
-    b = pos.pieces(Us, PAWN);
-    b = pawn_attacks_bb<Us>(b);
-  } else {
-    b = 0;
-    const Square* pl = pos.squares<Pt>(Us);
-    for (Square s = *pl; s != SQ_NONE; s = *++pl) {
-      b |= attacks_bb<Pt>(s, pos.pieces());
-    }
-  }
+#if defined(USE_MOBILITY_IN_STATEINFO)
+// Attacks of the pieces of color c and type pt, stored in StateInfo::mobility[c][pt - 1]
+Bitboard pieceMobility(const Position& pos, Color c, PieceType pt) {
+  if (pt == PAWN)
+      return c == WHITE ? pawn_attacks_bb<WHITE>(pos.pieces(WHITE, PAWN))
+                        : pawn_attacks_bb<BLACK>(pos.pieces(BLACK, PAWN));
+
+  Bitboard b = 0;
+  for (Bitboard pcs = pos.pieces(c, pt); pcs; )
+      b |= attacks_bb(pt, pop_lsb(&pcs), pos.pieces());
   return b;
 }
+#endif  // defined(USE_MOBILITY_IN_STATEINFO)
 
 
 /// Position::set_state() computes the hash keys of the position, and other
@@ -407,19 +405,12 @@ void Position::set_state(StateInfo* si) const {
           si->materialKey ^= Zobrist::psq[pc][cnt];
 
 #if defined(USE_MOBILITY_IN_STATEINFO)
-  si->mobility[0][0] = pieceMobility<PAWN, WHITE>(*this);
-  si->mobility[0][1] = pieceMobility<KNIGHT, WHITE>(*this);
-  si->mobility[0][2] = pieceMobility<BISHOP, WHITE>(*this);
-  si->mobility[0][3] = pieceMobility<ROOK, WHITE>(*this);
-  si->mobility[0][4] = pieceMobility<QUEEN, WHITE>(*this);
-  si->mobility[0][5] = pieceMobility<KING, WHITE>(*this);
-
-  si->mobility[1][0] = pieceMobility<PAWN, BLACK>(*this);
-  si->mobility[1][1] = pieceMobility<KNIGHT, BLACK>(*this);
-  si->mobility[1][2] = pieceMobility<BISHOP, BLACK>(*this);
-  si->mobility[1][3] = pieceMobility<ROOK, BLACK>(*this);
-  si->mobility[1][4] = pieceMobility<QUEEN, BLACK>(*this);
-  si->mobility[1][5] = pieceMobility<KING, BLACK>(*this);
+  for (Color c : { WHITE, BLACK })
+      for (PieceType pt = PAWN; pt <= KING; ++pt)
+          si->mobility[c][pt - 1] = pieceMobility(*this, c, pt);
+  si->mobilityChangedSquares = 0;
+  si->mobilityChangedPieces = 0;
+  si->mobilityComputed = true;
 #endif  // defined(USE_MOBILITY_IN_STATEINFO)
 
 #if defined(USE_PIECECOUNT_IN_STATEINFO)
@@ -754,7 +745,7 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
   // Copy some fields of the old state to our new StateInfo object except the
   // ones which are going to be recalculated from scratch anyway and then switch
   // our state pointer to point to the new (ready to be updated) state.
-  std::memcpy(&newSt, st, offsetof(StateInfo, key));
+  std::memcpy(static_cast<void*>(&newSt), st, offsetof(StateInfo, key));
   newSt.previous = st;
   st = &newSt;
 
@@ -781,6 +772,10 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
   PieceNumber piece_no1 = PIECE_NUMBER_NB;
 #endif  // defined(EVAL_NNUE)
 
+#if defined(USE_MOBILITY_IN_STATEINFO)
+  const Bitboard occupied = pieces();
+#endif  // defined(USE_MOBILITY_IN_STATEINFO)
+
   assert(color_of(pc) == us);
   assert(captured == NO_PIECE || color_of(captured) == (type_of(m) != CASTLING ? them : us));
   assert(type_of(captured) != KING);
@@ -972,19 +967,15 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
   set_check_info(st);
 
 #if defined(USE_MOBILITY_IN_STATEINFO)
-  st->mobility[0][0] = pieceMobility<PAWN, WHITE>(*this);
-  st->mobility[0][1] = pieceMobility<KNIGHT, WHITE>(*this);
-  st->mobility[0][2] = pieceMobility<BISHOP, WHITE>(*this);
-  st->mobility[0][3] = pieceMobility<ROOK, WHITE>(*this);
-  st->mobility[0][4] = pieceMobility<QUEEN, WHITE>(*this);
-  st->mobility[0][5] = pieceMobility<KING, WHITE>(*this);
-
-  st->mobility[1][0] = pieceMobility<PAWN, BLACK>(*this);
-  st->mobility[1][1] = pieceMobility<KNIGHT, BLACK>(*this);
-  st->mobility[1][2] = pieceMobility<BISHOP, BLACK>(*this);
-  st->mobility[1][3] = pieceMobility<ROOK, BLACK>(*this);
-  st->mobility[1][4] = pieceMobility<QUEEN, BLACK>(*this);
-  st->mobility[1][5] = pieceMobility<KING, BLACK>(*this);
+  // Only record what changed. update_mobility() computes the attacks when the
+  // evaluation asks for them, so nodes that are never evaluated do not pay.
+  st->mobilityComputed = false;
+  st->mobilityChangedSquares = occupied ^ pieces();
+  st->mobilityChangedPieces = (1 << pc) | (1 << st->capturedPiece);
+  if (type_of(m) == PROMOTION)
+      st->mobilityChangedPieces |= 1 << make_piece(us, promotion_type(m));
+  else if (type_of(m) == CASTLING)
+      st->mobilityChangedPieces |= 1 << make_piece(us, ROOK);
 #endif  // defined(USE_MOBILITY_IN_STATEINFO)
 
 #if defined(USE_PIECECOUNT_IN_STATEINFO)
@@ -1174,7 +1165,19 @@ void Position::do_null_move(StateInfo& newSt) {
   assert(!checkers());
   assert(&newSt != st);
 
+#if defined(EVAL_NNUE)
+  // Skip the accumulator, which is the bulk of StateInfo. A null move changes
+  // no piece, so evaluate() copies it from the previous state only if needed.
+  std::memcpy(static_cast<void*>(&newSt), st, offsetof(StateInfo, accumulator));
+  std::memcpy(reinterpret_cast<char*>(&newSt) + offsetof(StateInfo, dirtyPiece),
+              reinterpret_cast<const char*>(st) + offsetof(StateInfo, dirtyPiece),
+              sizeof(StateInfo) - offsetof(StateInfo, dirtyPiece));
+  newSt.accumulator.computed_accumulation = false;
+  newSt.accumulator.computed_score = false;
+  newSt.dirtyPiece.dirty_num = 0;
+#else
   std::memcpy(&newSt, st, sizeof(StateInfo));
+#endif
   newSt.previous = st;
   st = &newSt;
 
@@ -1187,10 +1190,6 @@ void Position::do_null_move(StateInfo& newSt) {
   st->key ^= Zobrist::side;
   prefetch(TT.first_entry(st->key));
 
-#if defined(EVAL_NNUE)
-  st->accumulator.computed_score = false;
-#endif
-
   ++st->rule50;
   st->pliesFromNull = 0;
 
@@ -1203,6 +1202,39 @@ void Position::do_null_move(StateInfo& newSt) {
   assert(pos_is_ok());
 }
 
+#if defined(USE_MOBILITY_IN_STATEINFO)
+/// Position::update_mobility() computes st->mobility if it is not up to date.
+/// When the previous state has it, only the entries that the last move may have
+/// changed are computed again: those of the pieces it moved, captured or
+/// created, and those of the sliders whose attacks reach a square whose
+/// occupancy changed. A null move keeps the changes of the move before it,
+/// which are still valid against the state before that move.
+
+void Position::update_mobility() const {
+
+  if (st->mobilityComputed)
+      return;
+
+  const StateInfo* prev = st->previous;
+  const bool incremental = prev && prev->mobilityComputed;
+
+  for (Color c : { WHITE, BLACK })
+      for (PieceType pt = PAWN; pt <= KING; ++pt)
+      {
+          Bitboard& b = st->mobility[c][pt - 1];
+          if (   !incremental
+              || (st->mobilityChangedPieces & (1 << make_piece(c, pt)))
+              || (   (pt == BISHOP || pt == ROOK || pt == QUEEN)
+                  && (prev->mobility[c][pt - 1] & st->mobilityChangedSquares)))
+              b = pieceMobility(*this, c, pt);
+          else
+              b = prev->mobility[c][pt - 1];
+      }
+
+  st->mobilityComputed = true;
+}
+#endif  // defined(USE_MOBILITY_IN_STATEINFO)
+
 void Position::undo_null_move() {
 
   assert(!checkers());
@@ -67,7 +67,12 @@ struct StateInfo {
   Eval::DirtyPiece dirtyPiece;
 
 #if defined(USE_MOBILITY_IN_STATEINFO)
+  // Attacks of the pieces of each color and type, computed on demand by
+  // Position::update_mobility() from the changes recorded by do_move().
   Bitboard mobility[2][6];
+  Bitboard mobilityChangedSquares; // squares whose occupancy the last move changed
+  int      mobilityChangedPieces;  // bit per Piece that the last move moved, captured or created
+  bool     mobilityComputed;
 #endif
 
 #if defined(USE_PIECECOUNT_IN_STATEINFO)
@@ -209,6 +214,11 @@ public:
   const Eval::EvalList* eval_list() const { return &evalList; }
 #endif  // defined(EVAL_NNUE) || defined(EVAL_LEARN)
 
+#if defined(USE_MOBILITY_IN_STATEINFO)
+  // Make state()->mobility up to date
+  void update_mobility() const;
+#endif  // defined(USE_MOBILITY_IN_STATEINFO)
+
 #if defined(EVAL_LEARN)
   // --sfenization helper
 
@@ -21,6 +21,7 @@
 #include <cassert>
 
 #include <algorithm> // For std::count
+#include <iostream>
 #include "movegen.h"
 #include "search.h"
 #include "thread.h"
@@ -53,6 +54,26 @@ Thread::~Thread() {
 }
 
 
+/// Thread::operator new() and operator delete() use the large page allocator
+
+void* Thread::operator new(size_t size) {
+
+  void* ptr = aligned_large_pages_alloc(size);
+  if (!ptr)
+  {
+      std::cerr << "Failed to allocate " << size << " bytes for a thread." << std::endl;
+      std::exit(EXIT_FAILURE);
+  }
+
+  return ptr;
+}
+
+void Thread::operator delete(void* ptr, size_t size) {
+
+  aligned_large_pages_free(ptr, size);
+}
+
+
 /// Thread::bestMoveCount(Move move) return best move counter for the given root move
 
 int Thread::best_move_count(Move move) const {
@@ -114,7 +135,22 @@ void Thread::idle_loop() {
   // some Windows NUMA hardware, for instance in fishtest. To make it simple,
   // just check if running threads are below a threshold, in this case all this
   // NUMA machinery is not needed.
-  if (Options["Threads"] > 8)
+  // A thread reading the copy of the evaluation data on its NUMA node must
+  // stay on that node whatever the number of threads. Both bind the thread to
+  // the same node, so that it is bound only once.
+  bool numaLocal = false;
+#if defined(EVAL_NNUE)
+  numaLocal = Options["EvalNumaReplication"];
+#if defined(USE_EVAL_HASH)
+  numaLocal = numaLocal || Options["EvalHashPerNode"];
+#endif
+#endif
+  if (numaLocal && Numa::node_count() > 1 && Numa::best_node(idx) >= 0)
+  {
+      numaNode = Numa::best_node(idx);
+      Numa::bind_this_thread(numaNode);
+  }
+  else if (Options["Threads"] > 8)
       WinProcGroup::bindThisThread(idx);
 
   while (true)
@@ -155,6 +191,9 @@ void ThreadPool::set(size_t requested) {
 
       // Reallocate the hash with the new threadpool size
       TT.resize(size_t(Options["Hash"]));
+#if defined(EVAL_NNUE) && defined(USE_EVAL_HASH)
+      Eval::resize_evalhash(size_t(Options["EvalHash"]));
+#endif
 
       // Init thread number dependent search params.
       Search::init();
@@ -214,6 +253,13 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   for (Thread* th : *this)
   {
       th->nodes = th->tbHits = th->nmpMinPly = th->bestMoveChanges = 0;
+#if defined(EVAL_NNUE) && defined(USE_EVAL_HASH)
+      th->evalHashHits = th->evalHashMisses = 0;
+#endif
+#if defined(EVAL_NNUE)
+      th->nnueRefreshes = th->nnueUpdates = th->nnueMultiPlyUpdates = 0;
+      th->nnueEvaluations = th->nnueEnsembleEvaluations = 0;
+#endif
       th->rootDepth = th->completedDepth = 0;
       th->rootMoves = rootMoves;
       th->rootPos.set(pos.fen(), pos.is_chess960(), &setupStates->back(), th);
@@ -51,6 +51,10 @@ class Thread {
 public:
   explicit Thread(size_t);
   virtual ~Thread();
+  // The histories and caches below are accessed at random, so they are placed
+  // on large pages like the transposition table.
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr, size_t size);
   virtual void search();
   void clear();
   void idle_loop();
@@ -65,6 +69,25 @@ public:
   int selDepth, nmpMinPly;
   Color nmpColor;
   std::atomic<uint64_t> nodes, tbHits, bestMoveChanges;
+#if defined(EVAL_NNUE) && defined(USE_EVAL_HASH)
+  std::atomic<uint64_t> evalHashHits, evalHashMisses;
+#endif
+#if defined(EVAL_NNUE)
+  // How the NNUE accumulators were computed: from scratch, from the previous
+  // ply, or from an earlier ply by walking back over several states
+  std::atomic<uint64_t> nnueRefreshes, nnueUpdates, nnueMultiPlyUpdates;
+  Eval::NNUE::RefreshCache nnueRefreshCache;
+  // Evaluations by the net in use and by the second net of the ensemble
+  // (EnsembleEvalFile), whose accumulators come from a cache of their own
+  std::atomic<uint64_t> nnueEvaluations, nnueEnsembleEvaluations;
+  Eval::NNUE::RefreshCache nnueEnsembleRefreshCache;
+  // NUMA node the thread is bound to, whose copy of the evaluation parameters
+  // and eval hash it reads (0 unless EvalNumaReplication or EvalHashPerNode)
+  int numaNode = 0;
+#endif
+#if defined(USE_PAWN_INDEX_IN_STATEINFO)
+  Eval::NNUE::Features::PawnStructureTable nnuePawnStructureTable;
+#endif
 
   Position rootPos;
   Search::RootMoves rootMoves;
@@ -75,6 +98,8 @@ public:
   CapturePieceToHistory captureHistory;
   ContinuationHistory continuationHistory[2][2];
   Score contempt;
+  // Search stack of Thread::search(), kept here so that it is on large pages too
+  Search::Stack searchStack[MAX_PLY+10];
 };
 
 
@@ -109,6 +134,17 @@ struct ThreadPool : public std::vector<Thread*> {
   MainThread* main()        const { return static_cast<MainThread*>(front()); }
   uint64_t nodes_searched() const { return accumulate(&Thread::nodes); }
   uint64_t tb_hits()        const { return accumulate(&Thread::tbHits); }
+#if defined(EVAL_NNUE) && defined(USE_EVAL_HASH)
+  uint64_t eval_hash_hits()   const { return accumulate(&Thread::evalHashHits); }
+  uint64_t eval_hash_misses() const { return accumulate(&Thread::evalHashMisses); }
+#endif
+#if defined(EVAL_NNUE)
+  uint64_t nnue_refreshes()         const { return accumulate(&Thread::nnueRefreshes); }
+  uint64_t nnue_updates()           const { return accumulate(&Thread::nnueUpdates); }
+  uint64_t nnue_multi_ply_updates() const { return accumulate(&Thread::nnueMultiPlyUpdates); }
+  uint64_t nnue_evaluations()       const { return accumulate(&Thread::nnueEvaluations); }
+  uint64_t nnue_ensemble_evaluations() const { return accumulate(&Thread::nnueEnsembleEvaluations); }
+#endif
   Thread* get_best_thread() const;
   void start_searching();
   void wait_for_search_finished() const;
@@ -18,11 +18,14 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
 
 #include "evaluate.h"
 #include "movegen.h"
@@ -34,6 +37,10 @@
 #include "uci.h"
 #include "syzygy/tbprobe.h"
 
+#if defined(EVAL_NNUE)
+#include "eval/nnue/evaluate_nnue.h"
+#endif
+
 #if defined(EVAL_NNUE) && defined(ENABLE_TEST_CMD)
 #include "eval/nnue/nnue_test_command.h"
 #endif
@@ -176,14 +183,29 @@ namespace {
   }
 
 
+  // Nodes searched and time spent by a run of bench, and the NNUE work done
+  struct BenchResult {
+    uint64_t nodes;
+    TimePoint elapsed;
+    uint64_t evaluations = 0, refreshes = 0;
+    uint64_t evalHashHits = 0, evalHashMisses = 0;
+  };
+
   // bench() is called when engine receives the "bench" command. Firstly
   // a list of UCI commands is setup according to bench parameters, then
   // it is run one by one printing a summary at the end.
 
-  void bench(Position& pos, istream& args, StateListPtr& states) {
+  BenchResult bench(Position& pos, istream& args, StateListPtr& states) {
 
     string token;
     uint64_t num, nodes = 0, cnt = 1;
+#if defined(EVAL_NNUE) && defined(USE_EVAL_HASH)
+    uint64_t evalHashHits = 0, evalHashMisses = 0;
+#endif
+#if defined(EVAL_NNUE)
+    uint64_t nnueRefreshes = 0, nnueUpdates = 0, nnueMultiPlyUpdates = 0;
+    uint64_t nnueEvaluations = 0, nnueEnsembleEvaluations = 0;
+#endif
 
     vector<string> list = setup_bench(pos, args);
     num = count_if(list.begin(), list.end(), [](string s) { return s.find("go ") == 0 || s.find("eval") == 0; });
@@ -203,6 +225,17 @@ namespace {
                go(pos, is, states);
                Threads.main()->wait_for_search_finished();
                nodes += Threads.nodes_searched();
+#if defined(EVAL_NNUE) && defined(USE_EVAL_HASH)
+               evalHashHits += Threads.eval_hash_hits();
+               evalHashMisses += Threads.eval_hash_misses();
+#endif
+#if defined(EVAL_NNUE)
+               nnueRefreshes += Threads.nnue_refreshes();
+               nnueUpdates += Threads.nnue_updates();
+               nnueMultiPlyUpdates += Threads.nnue_multi_ply_updates();
+               nnueEvaluations += Threads.nnue_evaluations();
+               nnueEnsembleEvaluations += Threads.nnue_ensemble_evaluations();
+#endif
             }
             else
                sync_cout << "\n" << Eval::trace(pos) << sync_endl;
@@ -227,8 +260,223 @@ namespace {
          << "\nTotal time (ms) : " << elapsed
          << "\nNodes searched  : " << nodes
          << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+
+#if defined(EVAL_NNUE) && defined(USE_EVAL_HASH)
+    if (evalHashHits + evalHashMisses)
+        cerr << "Eval hash hits  : " << evalHashHits << " / " << evalHashHits + evalHashMisses
+             << " (" << 100.0 * evalHashHits / (evalHashHits + evalHashMisses) << "%)" << endl;
+#endif
+
+#if defined(EVAL_NNUE)
+    uint64_t accumulators = nnueRefreshes + nnueUpdates + nnueMultiPlyUpdates;
+    if (accumulators)
+        cerr << "NNUE refreshes  : " << nnueRefreshes
+             << " (" << 100.0 * nnueRefreshes / accumulators << "%)"
+             << "\nNNUE updates    : " << nnueUpdates
+             << " (" << 100.0 * nnueUpdates / accumulators << "%)"
+             << "\nNNUE multi-ply  : " << nnueMultiPlyUpdates
+             << " (" << 100.0 * nnueMultiPlyUpdates / accumulators << "%)" << endl;
+
+    if (nnueEvaluations)
+        cerr << "NNUE evals      : " << nnueEvaluations
+             << " (" << 1000 * nnueEvaluations / elapsed << " evals/s)" << endl;
+    if (nnueEnsembleEvaluations)
+        cerr << "Ensemble evals  : " << nnueEnsembleEvaluations
+             << " (" << 100.0 * nnueEnsembleEvaluations / std::max(nnueEvaluations, uint64_t(1))
+             << "% of NNUE evals, " << 1000 * nnueEnsembleEvaluations / elapsed << " evals/s)" << endl;
+#endif
+
+    BenchResult result = { nodes, elapsed };
+#if defined(EVAL_NNUE)
+    result.evaluations = nnueEvaluations;
+    result.refreshes = nnueRefreshes;
+#endif
+#if defined(EVAL_NNUE) && defined(USE_EVAL_HASH)
+    result.evalHashHits = evalHashHits;
+    result.evalHashMisses = evalHashMisses;
+#endif
+    return result;
+  }
+
+
+  // bench_threads() is called by "bench threads", which takes the parameters
+  // of bench with the number of threads as the maximum (default: the number of
+  // logical processors). bench is run with 1, 2, 4, ... threads up to it, and
+  // the nodes per second are reported relative to those of a single thread.
+
+  void bench_threads(Position& pos, istream& args, StateListPtr& states) {
+
+    string token, rest;
+    string ttSize = (args >> token) ? token : "16";
+    int maxThreads = (args >> token) ? stoi(token) : max(int(thread::hardware_concurrency()), 1);
+    getline(args, rest);
+
+    vector<int> threads;
+    for (int t = 1; t < maxThreads; t *= 2)
+        threads.push_back(t);
+    threads.push_back(maxThreads);
+
+    vector<BenchResult> results;
+    for (int t : threads)
+    {
+        istringstream is(ttSize + " " + to_string(t) + rest);
+        results.push_back(bench(pos, is, states));
+    }
+
+    const double nps1 = 1000.0 * results[0].nodes / results[0].elapsed;
+    stringstream ss;
+
+    ss << "\n==========================="
+       << "\nThreads        Nodes   Time (ms)  Nodes/second  Speedup  Efficiency\n";
+
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        uint64_t nps = 1000 * results[i].nodes / results[i].elapsed;
+        ss << setw(7)  << threads[i]
+           << setw(13) << results[i].nodes
+           << setw(12) << results[i].elapsed
+           << setw(14) << nps
+           << setw(8)  << fixed << setprecision(2) << nps / nps1 << "x"
+           << setw(11) << setprecision(1) << 100.0 * nps / nps1 / threads[i] << "%\n";
+    }
+
+    cerr << ss.str();
   }
 
+#if defined(EVAL_NNUE)
+  // bench_nnue_archs() is called by "bench nnue-archs", which takes the output
+  // format (text, json or csv), a comma separated list of evaluation function
+  // files (default: EvalFile) and the parameters of bench. bench is run with
+  // each file, and the speed of the evaluation of each architecture is printed
+  // to stdout, so that it can be collected by scripts. Supported architectures
+  // without a file are listed as missing.
+
+  void bench_nnue_archs(Position& pos, istream& args, StateListPtr& states) {
+
+    string token, rest;
+    const string format = (args >> token) ? token : "text";
+    const string evalFile = Options["EvalFile"];
+    string fileList = (args >> token) ? token : evalFile;
+    getline(args, rest);
+
+    if (format != "text" && format != "json" && format != "csv")
+    {
+        sync_cout << "Unknown format " << format << ", use text, json or csv" << sync_endl;
+        return;
+    }
+
+    struct ArchResult {
+      string file, features, network;
+      BenchResult bench;
+    };
+    vector<ArchResult> results;
+    vector<string> missing = Eval::NNUE::GetSupportedArchitectureStrings();
+
+    istringstream files(fileList);
+    string file;
+    while (getline(files, file, ','))
+    {
+        string architecture;
+        if (!Eval::NNUE::GetFileArchitectureString(file, &architecture))
+        {
+            cerr << "Skipping " << file << ": not found or not a supported architecture" << endl;
+            continue;
+        }
+        missing.erase(std::remove(missing.begin(), missing.end(), architecture), missing.end());
+
+        Options["EvalFile"] = file;
+        istringstream is(rest);
+        ArchResult r;
+        r.file = file;
+        r.bench = bench(pos, is, states);
+
+        // "Features=...,Network=..."
+        const size_t network = architecture.find(",Network=");
+        r.features = architecture.substr(9, network - 9);
+        r.network = architecture.substr(network + 9);
+        results.push_back(r);
+    }
+    Options["EvalFile"] = evalFile;
+
+    auto perSecond = [](uint64_t n, TimePoint elapsed) { return 1000 * n / elapsed; };
+    auto hitRate = [](const BenchResult& b) {
+        return b.evalHashHits + b.evalHashMisses ?
+            100.0 * b.evalHashHits / (b.evalHashHits + b.evalHashMisses) : -1.0;
+    };
+    auto quoted = [](const string& str, char escape) {
+        string q = "\"";
+        for (char c : str)
+            q += c == '"' || c == escape ? string(1, escape) + c : string(1, c);
+        return q + '"';
+    };
+
+    stringstream ss;
+    ss << fixed << setprecision(2);
+
+    if (format == "json")
+    {
+        ss << "{\"engine\": " << quoted(engine_info(), '\\') << ", \"results\": [";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const BenchResult& b = results[i].bench;
+            ss << (i ? ", " : "")
+               << "{\"file\": " << quoted(results[i].file, '\\')
+               << ", \"features\": " << quoted(results[i].features, '\\')
+               << ", \"network\": " << quoted(results[i].network, '\\')
+               << ", \"nodes\": " << b.nodes
+               << ", \"time_ms\": " << b.elapsed
+               << ", \"nps\": " << perSecond(b.nodes, b.elapsed)
+               << ", \"evals_per_second\": " << perSecond(b.evaluations, b.elapsed)
+               << ", \"refreshes_per_second\": " << perSecond(b.refreshes, b.elapsed)
+               << ", \"eval_hash_hit_rate\": ";
+            if (hitRate(b) < 0)
+                ss << "null}";
+            else
+                ss << hitRate(b) << "}";
+        }
+        ss << "], \"missing\": [";
+        for (size_t i = 0; i < missing.size(); ++i)
+            ss << (i ? ", " : "") << quoted(missing[i], '\\');
+        ss << "]}";
+    }
+    else if (format == "csv")
+    {
+        ss << "file,features,network,nodes,time_ms,nps,evals_per_second,refreshes_per_second,eval_hash_hit_rate";
+        for (const auto& r : results)
+        {
+            ss << "\n" << quoted(r.file, '"') << ',' << quoted(r.features, '"')
+               << ',' << quoted(r.network, '"') << ',' << r.bench.nodes
+               << ',' << r.bench.elapsed << ',' << perSecond(r.bench.nodes, r.bench.elapsed)
+               << ',' << perSecond(r.bench.evaluations, r.bench.elapsed)
+               << ',' << perSecond(r.bench.refreshes, r.bench.elapsed) << ',';
+            if (hitRate(r.bench) >= 0)
+                ss << hitRate(r.bench);
+        }
+    }
+    else
+    {
+        ss << "\n==========================="
+           << "\nNodes/second  Evals/second  Refreshes/second  Eval hash hits  Features";
+        for (const auto& r : results)
+        {
+            ss << "\n" << setw(12) << perSecond(r.bench.nodes, r.bench.elapsed)
+               << setw(14) << perSecond(r.bench.evaluations, r.bench.elapsed)
+               << setw(18) << perSecond(r.bench.refreshes, r.bench.elapsed);
+            if (hitRate(r.bench) >= 0)
+                ss << setw(15) << hitRate(r.bench) << "%";
+            else
+                ss << setw(16) << "-";
+            ss << "  " << r.features;
+        }
+        for (const auto& m : missing)
+            ss << "\nNo evaluation function file for "
+               << m.substr(9, m.find(",Network=") - 9);
+    }
+
+    sync_cout << ss.str() << sync_endl;
+  }
+#endif
+
   // The win rate model returns the probability (per mille) of winning given an eval
   // and a game-ply. The model fits rather accurately the LTC fishtest statistics.
   int win_rate_model(Value v, int ply) {
@@ -392,7 +640,24 @@ void UCI::loop(int argc, char* argv[]) {
       // Additional custom non-UCI commands, mainly for debugging.
       // Do not use these commands during a search!
       else if (token == "flip")     pos.flip();
-      else if (token == "bench")    bench(pos, is, states);
+      else if (token == "bench")
+      {
+          // "bench threads ..." reports the scaling with the number of threads
+          // and "bench nnue-archs ..." the speed of each NNUE architecture
+          auto args = is.tellg();
+          if (is >> token && token == "threads")
+              bench_threads(pos, is, states);
+#if defined(EVAL_NNUE)
+          else if (token == "nnue-archs")
+              bench_nnue_archs(pos, is, states);
+#endif
+          else
+          {
+              is.clear();
+              is.seekg(args);
+              bench(pos, is, states);
+          }
+      }
       else if (token == "d")        sync_cout << pos << sync_endl;
       else if (token == "eval")     sync_cout << Eval::trace(pos) << sync_endl;
       else if (token == "compiler") sync_cout << compiler_info() << sync_endl;
@@ -43,6 +43,15 @@ void on_logger(const Option& o) { start_logger(o); }
 void on_threads(const Option& o) { Threads.set(size_t(o)); }
 void on_tb_path(const Option& o) { Tablebases::init(o); }
 void on_eval_file(const Option& o) { load_eval_finished = false; init_nnue(); }
+void on_large_pages(const Option& o) { use_large_pages(o); Threads.set(size_t(Options["Threads"])); on_eval_file(o); }
+void on_eval_numa(const Option& o) { Threads.set(size_t(Options["Threads"])); on_eval_file(o); }
+#if defined(EVAL_NNUE)
+void on_eval_ensemble(const Option&) { Eval::update_ensemble_policy(); }
+#endif
+#if defined(EVAL_NNUE) && defined(USE_EVAL_HASH)
+void on_eval_hash_size(const Option& o) { Eval::resize_evalhash(size_t(o)); }
+void on_eval_hash_per_node(const Option&) { Threads.set(size_t(Options["Threads"])); }
+#endif
 
 
 /// Our case insensitive less() function as required by UCI protocol
@@ -65,6 +74,8 @@ void init(OptionsMap& o) {
   o["Threads"]               << Option(1, 1, 512, on_threads);
   o["Hash"]                  << Option(16, 1, MaxHashMB, on_hash_size);
   o["Clear Hash"]            << Option(on_clear_hash);
+  // Use large pages for the hash tables, the evaluation function parameters and the thread data
+  o["LargePages"]            << Option(true, on_large_pages);
   o["Ponder"]                << Option(false);
   o["MultiPV"]               << Option(1, 1, 500);
   o["Skill Level"]           << Option(20, 0, 20);
@@ -84,6 +95,30 @@ void init(OptionsMap& o) {
   // Evaluation function file name. When this is changed, it is necessary to reread the evaluation function at the next ucinewgame timing.
   // Without the preceding "./", some GUIs can not load he net file.
   o["EvalFile"]              << Option("./eval/nn.bin", on_eval_file);
+  // When the evaluation function file is an aligned image (learn convert_eval_image),
+  // map it read-only so that the parameters are shared by all processes using it.
+  o["EvalFileMmap"]          << Option(true, on_eval_file);
+  // Also keep the weights of the feature transformer as int8 with a scale per feature
+  // when they fit, which halves the memory read to update the accumulator.
+  o["EvalCompressWeights"]   << Option(false, on_eval_file);
+  // On a NUMA machine, bind the threads to the nodes and give each node its own copy
+  // of the evaluation function parameters, so that they are not read from a remote node.
+  o["EvalNumaReplication"]   << Option(false, on_eval_numa);
+  // Second evaluation function file (.bin) of any architecture, blended into the
+  // static evaluation at PV nodes and near 0 by the game phase. "<empty>" disables it.
+  o["EnsembleEvalFile"]      << Option("<empty>", on_eval_file);
+  o["EnsemblePV"]            << Option(true, on_eval_ensemble);
+  o["EnsembleMargin"]        << Option(100, 0, int(VALUE_INFINITE), on_eval_ensemble);
+  // Share of the second net in percent in the midgame and in the endgame
+  o["EnsembleWeightMg"]      << Option(100, 0, 100, on_eval_ensemble);
+  o["EnsembleWeightEg"]      << Option(100, 0, 100, on_eval_ensemble);
+#if defined(USE_EVAL_HASH)
+  // Size of the hash table of evaluation values in MB, rounded down to a power of 2. 0 disables it.
+  o["EvalHash"]              << Option(128, 0, MaxHashMB, on_eval_hash_size);
+  // On a NUMA machine, bind the threads to the nodes and give each node its own eval hash
+  // of EvalHash MB, which is shared only by the threads of the node.
+  o["EvalHashPerNode"]       << Option(false, on_eval_hash_per_node);
+#endif
   // When the evaluation function is loaded at the ucinewgame timing, it is necessary to convert the new evaluation function.
   // I want to hit the test eval convert command, but there is no new evaluation function
   // It ends abnormally before executing this command.